@@ -3,6 +3,15 @@
 #include <algorithm>
 #include <iomanip>
 #include <queue>
+#include <deque>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <climits>
+#include <random>
+
+#include "../common/profiler.h"
 
 using namespace std;
 
@@ -12,6 +21,7 @@ struct Process {
     int arrivalTime;
     int burstTime;
     int priority;
+    int deadline; // Only used by EDF
 
     // These will be calculated by the algorithms
     int startTime;
@@ -21,6 +31,18 @@ struct Process {
     int remainingTime; // For preemptive algorithms
 };
 
+// Profiling hooks, reported when SPOS_PROFILE is set
+prof::Timer fcfs_timer("fcfs");
+prof::Timer sjf_timer("sjf_preemptive");
+prof::Timer priority_timer("priority_non_preemptive");
+prof::Timer rr_timer("round_robin");
+prof::Timer hrrn_timer("hrrn");
+prof::Timer lottery_timer("lottery");
+prof::Timer edf_timer("edf");
+prof::Counter processes_counter("processes_scheduled");
+prof::Counter dispatch_counter("dispatches");
+prof::Counter time_units_counter("time_units_simulated");
+
 // Function to print the final results table
 void printResults(const vector<Process>& processes, const string& algorithmName) {
     int n = processes.size();
@@ -52,175 +74,637 @@ void printResults(const vector<Process>& processes, const string& algorithmName)
     cout << endl;
 }
 
-// 1. First-Come, First-Served (FCFS)
-void fcfs(vector<Process> processes) {
-    int n = processes.size();
-    // Sort processes by arrival time
-    sort(processes.begin(), processes.end(), [](const Process& a, const Process& b) {
-        return a.arrivalTime < b.arrivalTime;
-    });
+// Scheduling policies. Both simulation engines below are templates over
+// these, so each policy gets its own copy of the loop with key() inlined.
+// The ready process with the lowest key runs next, ties going to the lower
+// pid.
+//
+//   preemptive     an arrival can take the CPU from the running process
+//   fifo           no key: processes run in the order they become ready
+//   timeDependent  the key changes while a process waits, so the ready queue
+//                  is scanned on every dispatch instead of kept as a heap
+//   quantum        length of a time slice, 0 to run until completion
 
-    int currentTime = 0;
-    cout << "\nGantt Chart (FCFS):\n|";
-    for (int i = 0; i < n; ++i) {
-        if (currentTime < processes[i].arrivalTime) {
-            currentTime = processes[i].arrivalTime;
-        }
-        processes[i].startTime = currentTime;
-        processes[i].completionTime = currentTime + processes[i].burstTime;
-        processes[i].turnaroundTime = processes[i].completionTime - processes[i].arrivalTime;
-        processes[i].waitingTime = processes[i].turnaroundTime - processes[i].burstTime;
-        
-        cout << " P" << processes[i].pid << " (" << processes[i].completionTime << ") |";
-        
-        currentTime = processes[i].completionTime;
+struct FcfsPolicy {
+    static constexpr bool preemptive = false;
+    static constexpr bool fifo = true;
+    static constexpr bool timeDependent = false;
+    int quantum = 0;
+};
+
+struct SjfPolicy {
+    static constexpr bool preemptive = true;
+    static constexpr bool fifo = false;
+    static constexpr bool timeDependent = false;
+    int quantum = 0;
+
+    template <class P> double key(const P& p, long long) { return p.remainingTime; }
+};
+
+// Lower number means higher priority
+struct PriorityPolicy {
+    static constexpr bool preemptive = false;
+    static constexpr bool fifo = false;
+    static constexpr bool timeDependent = false;
+    int quantum = 0;
+
+    template <class P> double key(const P& p, long long) { return p.priority; }
+};
+
+struct RoundRobinPolicy {
+    static constexpr bool preemptive = false;
+    static constexpr bool fifo = true;
+    static constexpr bool timeDependent = false;
+    int quantum;
+};
+
+// Highest Response Ratio Next: (waiting + burst) / burst, non-preemptive
+struct HrrnPolicy {
+    static constexpr bool preemptive = false;
+    static constexpr bool fifo = false;
+    static constexpr bool timeDependent = true;
+    int quantum = 0;
+
+    template <class P> double key(const P& p, long long now) {
+        return -(double)(now - p.arrivalTime + p.burstTime) / p.burstTime;
     }
-    cout << endl;
-    printResults(processes, "First-Come, First-Served");
-}
+};
 
-// 2. Shortest Job First (SJF) - Preemptive (also called SRTF)
-void sjfPreemptive(vector<Process> processes) {
-    int n = processes.size();
-    int completed = 0;
-    int currentTime = 0;
-    
-    cout << "\nGantt Chart (Preemptive SJF):\n|";
-    while (completed != n) {
-        int shortestJobIndex = -1;
-        int shortestBurst = 1e9; // A very large number
-
-        // Find the process with the shortest remaining time that has arrived
-        for (int i = 0; i < n; ++i) {
-            if (processes[i].arrivalTime <= currentTime && processes[i].remainingTime > 0) {
-                if (processes[i].remainingTime < shortestBurst) {
-                    shortestBurst = processes[i].remainingTime;
-                    shortestJobIndex = i;
-                }
-            }
+// A fresh draw for every time slice. A process with priority p holds tickets
+// in proportion to 1 / (p + 1); each ready process draws an exponential time
+// with its ticket count as the rate and the earliest wins, which picks it
+// with probability tickets / total tickets.
+struct LotteryPolicy {
+    static constexpr bool preemptive = false;
+    static constexpr bool fifo = false;
+    static constexpr bool timeDependent = true;
+    int quantum;
+    mt19937_64 rng;
+
+    LotteryPolicy(int q, unsigned long long seed) : quantum(q), rng(seed) {}
+
+    template <class P> double key(const P& p, long long) {
+        double u = ((rng() >> 11) + 1) * (1.0 / 9007199254740992.0); // (0, 1]
+        return -log(u) * (max(p.priority, 0) + 1);
+    }
+};
+
+// Earliest Deadline First, preemptive
+struct EdfPolicy {
+    static constexpr bool preemptive = true;
+    static constexpr bool fifo = false;
+    static constexpr bool timeDependent = false;
+    int quantum = 0;
+
+    template <class P> double key(const P& p, long long) { return p.deadline; }
+};
+
+// Ready processes, held as indices into the caller's process table and
+// ordered by Policy's key
+template <class Policy, class P>
+class ReadyQueue {
+public:
+    ReadyQueue(Policy& policy, const vector<P>& table) : policy_(policy), table_(table) {}
+
+    bool empty() const { return size() == 0; }
+    int size() const { return Policy::fifo ? fifo_.size() : entries_.size(); }
+
+    void push(int index, long long now) {
+        if constexpr (Policy::fifo) {
+            fifo_.push_back(index);
+        } else if constexpr (!Policy::timeDependent) {
+            entries_.push_back({policy_.key(table_[index], now), table_[index].pid, index});
+            push_heap(entries_.begin(), entries_.end(), runsAfter);
+        } else {
+            entries_.push_back({0, table_[index].pid, index});
         }
+    }
 
-        if (shortestJobIndex == -1) {
-            currentTime++; // No process is ready, CPU is idle
+    int pop(long long now) {
+        if constexpr (Policy::fifo) {
+            int index = fifo_.front();
+            fifo_.pop_front();
+            return index;
+        }
+        if constexpr (!Policy::timeDependent) {
+            pop_heap(entries_.begin(), entries_.end(), runsAfter);
         } else {
-            // Execute the shortest job for one time unit
-            processes[shortestJobIndex].remainingTime--;
-            cout << " P" << processes[shortestJobIndex].pid << " |";
-            currentTime++;
-
-            if (processes[shortestJobIndex].remainingTime == 0) {
-                processes[shortestJobIndex].completionTime = currentTime;
-                processes[shortestJobIndex].turnaroundTime = processes[shortestJobIndex].completionTime - processes[shortestJobIndex].arrivalTime;
-                processes[shortestJobIndex].waitingTime = processes[shortestJobIndex].turnaroundTime - processes[shortestJobIndex].burstTime;
-                completed++;
-            }
+            for (auto& e : entries_) e.key = policy_.key(table_[e.index], now);
+            auto best = min_element(entries_.begin(), entries_.end(), [](const Entry& a, const Entry& b) {
+                return runsAfter(b, a);
+            });
+            swap(*best, entries_.back());
         }
+        int index = entries_.back().index;
+        entries_.pop_back();
+        return index;
     }
-    cout << " (end at " << currentTime << ")" << endl;
-    printResults(processes, "Preemptive Shortest Job First (SRTF)");
-}
 
-// 3. Priority Scheduling (Non-Preemptive)
-void priorityNonPreemptive(vector<Process> processes) {
+private:
+    struct Entry {
+        double key;
+        long long pid; // 64-bit so a long online run cannot wrap it
+        int index;
+    };
+
+    static bool runsAfter(const Entry& a, const Entry& b) {
+        if (a.key != b.key) return a.key > b.key;
+        return a.pid > b.pid;
+    }
+
+    Policy& policy_;
+    const vector<P>& table_;
+    deque<int> fifo_;
+    vector<Entry> entries_;
+};
+
+// Run every process to completion under the policy and return them in pid
+// order with their times filled in. The clock jumps from event to event:
+// an arrival, a completion or the end of a time slice. Preemptive and
+// time-sliced policies print the Gantt chart one cell per time unit, the
+// others one cell per process with its completion time.
+template <class Policy>
+vector<Process> simulate(vector<Process> processes, Policy policy, const string& ganttName) {
     int n = processes.size();
-    int completed = 0;
+    processes_counter.add(n);
+
+    vector<int> byArrival(n);
+    for (int i = 0; i < n; ++i) byArrival[i] = i;
+    auto arrivesFirst = [&](int a, int b) { return processes[a].arrivalTime < processes[b].arrivalTime; };
+    if (!is_sorted(byArrival.begin(), byArrival.end(), arrivesFirst)) {
+        stable_sort(byArrival.begin(), byArrival.end(), arrivesFirst);
+    }
+
+    ReadyQueue<Policy, Process> ready(policy, processes);
+    const bool perUnit = Policy::preemptive || policy.quantum > 0;
     int currentTime = 0;
-    vector<bool> isCompleted(n, false);
-    
-    cout << "\nGantt Chart (Non-Preemptive Priority):\n|";
-    while(completed != n) {
-        int highestPriorityIndex = -1;
-        int highestPriority = 1e9; // Lower number means higher priority
-
-        // Find the available process with the highest priority
-        for(int i = 0; i < n; i++) {
-            if(processes[i].arrivalTime <= currentTime && !isCompleted[i]) {
-                if(processes[i].priority < highestPriority) {
-                    highestPriority = processes[i].priority;
-                    highestPriorityIndex = i;
-                }
+    int next = 0;
+    int completed = 0;
+    int current = -1; // Index of the running process
+    int sliceLeft = 0;
+    int lastPid = 0;
+
+    auto nextArrival = [&]() { return processes[byArrival[next]].arrivalTime; };
+    auto admit = [&]() {
+        while (next < n && nextArrival() <= currentTime) {
+            ready.push(byArrival[next++], currentTime);
+        }
+    };
+
+    cout << "\nGantt Chart (" << ganttName << "):\n|";
+    while (completed < n) {
+        admit();
+        if (current < 0) {
+            if (ready.empty()) {
+                currentTime = nextArrival(); // CPU is idle until the next arrival
+                continue;
             }
+            current = ready.pop(currentTime);
+            sliceLeft = policy.quantum;
+            Process& p = processes[current];
+            if (p.remainingTime == p.burstTime) p.startTime = currentTime;
+            if (p.pid != lastPid) dispatch_counter.add();
+            lastPid = p.pid;
         }
 
-        if (highestPriorityIndex == -1) {
-            currentTime++;
-        } else {
-            processes[highestPriorityIndex].startTime = currentTime;
-            processes[highestPriorityIndex].completionTime = currentTime + processes[highestPriorityIndex].burstTime;
-            processes[highestPriorityIndex].turnaroundTime = processes[highestPriorityIndex].completionTime - processes[highestPriorityIndex].arrivalTime;
-            processes[highestPriorityIndex].waitingTime = processes[highestPriorityIndex].turnaroundTime - processes[highestPriorityIndex].burstTime;
-            
-            currentTime = processes[highestPriorityIndex].completionTime;
-            
-            cout << " P" << processes[highestPriorityIndex].pid << " (" << currentTime << ") |";
-            
-            isCompleted[highestPriorityIndex] = true;
+        Process& p = processes[current];
+        int until = currentTime + p.remainingTime;
+        if (policy.quantum > 0) until = min(until, currentTime + sliceLeft);
+        if (Policy::preemptive && next < n) until = min(until, nextArrival());
+
+        if (perUnit) {
+            for (int t = currentTime; t < until; ++t) cout << " P" << p.pid << " |";
+        }
+        p.remainingTime -= until - currentTime;
+        sliceLeft -= until - currentTime;
+        currentTime = until;
+
+        if (p.remainingTime == 0) {
+            p.completionTime = currentTime;
+            p.turnaroundTime = p.completionTime - p.arrivalTime;
+            p.waitingTime = p.turnaroundTime - p.burstTime;
+            if (!perUnit) cout << " P" << p.pid << " (" << currentTime << ") |";
+            current = -1;
             completed++;
+        } else if ((policy.quantum > 0 && sliceLeft == 0) ||
+                   (Policy::preemptive && next < n && nextArrival() == currentTime)) {
+            admit(); // Arrivals at this instant queue ahead of the process being put back
+            ready.push(current, currentTime);
+            current = -1;
         }
     }
+    time_units_counter.add(currentTime);
+    if (perUnit) cout << " (end at " << currentTime << ")";
     cout << endl;
-    printResults(processes, "Non-Preemptive Priority");
+    return processes;
+}
+
+// 1. First-Come, First-Served (FCFS)
+void fcfs(const vector<Process>& processes) {
+    prof::Scope timing(fcfs_timer);
+    printResults(simulate(processes, FcfsPolicy(), "FCFS"), "First-Come, First-Served");
+}
+
+// 2. Shortest Job First (SJF) - Preemptive (also called SRTF)
+void sjfPreemptive(const vector<Process>& processes) {
+    prof::Scope timing(sjf_timer);
+    printResults(simulate(processes, SjfPolicy(), "Preemptive SJF"), "Preemptive Shortest Job First (SRTF)");
+}
+
+// 3. Priority Scheduling (Non-Preemptive)
+void priorityNonPreemptive(const vector<Process>& processes) {
+    prof::Scope timing(priority_timer);
+    printResults(simulate(processes, PriorityPolicy(), "Non-Preemptive Priority"), "Non-Preemptive Priority");
 }
 
 // 4. Round Robin (RR)
-void roundRobin(vector<Process> processes, int timeQuantum) {
-    int n = processes.size();
-    queue<int> readyQueue;
-    int currentTime = 0;
-    int completed = 0;
-    
-    // Sort by arrival time to handle process arrivals correctly
-    sort(processes.begin(), processes.end(), [](const Process& a, const Process& b) {
-        return a.arrivalTime < b.arrivalTime;
-    });
-
-    int currentProcessIndex = 0;
-    cout << "\nGantt Chart (Round Robin with TQ=" << timeQuantum << "):\n|";
-
-    readyQueue.push(currentProcessIndex++); // Push the first process
-
-    while(completed < n) {
-        if (readyQueue.empty()) {
-            currentTime++;
-            // Check if new processes have arrived during idle time
-            while (currentProcessIndex < n && processes[currentProcessIndex].arrivalTime <= currentTime) {
-                readyQueue.push(currentProcessIndex++);
-            }
-            continue;
+void roundRobin(const vector<Process>& processes, int timeQuantum) {
+    prof::Scope timing(rr_timer);
+    string name = "Round Robin with TQ=" + to_string(timeQuantum);
+    printResults(simulate(processes, RoundRobinPolicy{timeQuantum}, name), "Round Robin");
+}
+
+// 5. Highest Response Ratio Next (HRRN)
+void hrrn(const vector<Process>& processes) {
+    prof::Scope timing(hrrn_timer);
+    printResults(simulate(processes, HrrnPolicy(), "HRRN"), "Highest Response Ratio Next");
+}
+
+// 6. Lottery, weighted by priority
+void lottery(const vector<Process>& processes, int timeQuantum, unsigned long long seed) {
+    prof::Scope timing(lottery_timer);
+    string name = "Lottery with TQ=" + to_string(timeQuantum);
+    printResults(simulate(processes, LotteryPolicy(timeQuantum, seed), name), "Lottery");
+}
+
+// 7. Earliest Deadline First (EDF) - Preemptive
+void edf(const vector<Process>& processes) {
+    prof::Scope timing(edf_timer);
+    vector<Process> results = simulate(processes, EdfPolicy(), "EDF");
+    printResults(results, "Earliest Deadline First");
+
+    int missed = 0;
+    for (const auto& p : results) {
+        if (p.completionTime > p.deadline) {
+            cout << "P" << p.pid << " missed its deadline of " << p.deadline << " by "
+                 << p.completionTime - p.deadline << endl;
+            missed++;
         }
+    }
+    cout << "Deadlines missed: " << missed << " of " << results.size() << endl;
+}
+
+// Online mode: schedule a stream of arrivals as it is read
+//
+//   ./main --online [FILE|-] [--policy NAME] [--quantum Q] [--seed S]
+//          [--interval T] [--window W]
+//
+// NAME is fcfs, sjf, priority, rr, hrrn, lottery or edf. Each input line is
+// "arrival burst [priority [deadline]]", in non-decreasing order of arrival.
+// FILE may be a FIFO that another program keeps writing to. Every T units of
+// simulated time a line of metrics over the last W units is printed.
+// Finished processes only update fixed-size histograms, so memory depends on
+// the ready queue length and W / T, not on how many processes have finished.
+
+prof::Timer online_timer("online");
+
+// Waiting times, exact below 16 and then 8 buckets per power of two
+// (at most 12.5% relative error)
+struct WaitHistogram {
+    static const int BUCKETS = 16 + 27 * 8;
+    long long counts[BUCKETS] = {};
+    long long total = 0;
+
+    static int bucketOf(long long v) {
+        if (v < 16) return v < 0 ? 0 : (int)v;
+        if (v > INT_MAX) v = INT_MAX;
+        int e = 31 - __builtin_clz((unsigned)v);
+        return 16 + (e - 4) * 8 + (int)((v >> (e - 3)) & 7);
+    }
+
+    static long long lowerBound(int b) {
+        if (b < 16) return b;
+        int e = (b - 16) / 8 + 4;
+        return (long long)(8 + (b - 16) % 8) << (e - 3);
+    }
 
-        int processIdx = readyQueue.front();
-        readyQueue.pop();
+    void add(long long v) {
+        counts[bucketOf(v)]++;
+        total++;
+    }
 
-        int executionTime = min(timeQuantum, processes[processIdx].remainingTime);
-        
-        for (int i = 0; i < executionTime; ++i) {
-             cout << " P" << processes[processIdx].pid << " |";
+    void merge(const WaitHistogram& other) {
+        for (int b = 0; b < BUCKETS; ++b) counts[b] += other.counts[b];
+        total += other.total;
+    }
+
+    // Lower bound of the bucket holding the p-th fraction of the samples
+    long long percentile(double p) const {
+        if (total == 0) return 0;
+        long long rank = max(1LL, (long long)ceil(p * total));
+        long long seen = 0;
+        for (int b = 0; b < BUCKETS; ++b) {
+            seen += counts[b];
+            if (seen >= rank) return lowerBound(b);
         }
-        
-        processes[processIdx].remainingTime -= executionTime;
-        currentTime += executionTime;
+        return lowerBound(BUCKETS - 1);
+    }
+};
+
+// What the metrics need from one publishing interval
+struct IntervalStats {
+    WaitHistogram waits;
+    long long completed = 0;
+    long long waitSum = 0;
+    long long busy = 0;      // Time units the CPU spent running a process
+    long long queueArea = 0; // Ready queue length summed over each time unit
+    int maxQueue = 0;
+};
+
+// Process in the online mode, where times can exceed an int
+struct LiveProcess {
+    long long pid; // Arrival number, which a long-running stream can take past INT_MAX
+    long long arrivalTime;
+    int burstTime;
+    int priority;
+    long long deadline; // LLONG_MAX when none was given
+    int remainingTime;
+};
+
+template <class Policy>
+class OnlineScheduler {
+public:
+    OnlineScheduler(Policy policy, long long interval, int windowIntervals)
+        : policy_(policy), ready_(policy_, table_), interval_(interval), nextPublish_(interval),
+          ring_(windowIntervals) {}
 
-        // Check for new arrivals during the execution of the current process
-        while (currentProcessIndex < n && processes[currentProcessIndex].arrivalTime <= currentTime) {
-            readyQueue.push(currentProcessIndex++);
+    // Run the clock up to the arrival time, then admit the process
+    void arrive(long long arrivalTime, int burstTime, int priority, long long deadline) {
+        if (arrivalTime < clock_) {
+            arrivalTime = clock_; // Out of order: treat it as arriving now
+            late_++;
         }
+        advanceTo(arrivalTime);
+        processes_counter.add();
+        arrived_++;
 
-        if (processes[processIdx].remainingTime > 0) {
-            readyQueue.push(processIdx); // Put it back in the queue
+        // A preemptive policy picks again from everything ready, the running process
+        // included, when the clock next moves; until then it still counts as running
+        if (Policy::preemptive && running_) preempted_ = true;
+        LiveProcess p = {arrived_, arrivalTime, burstTime, priority, deadline, burstTime};
+        int index;
+        if (!freeSlots_.empty()) {
+            index = freeSlots_.back();
+            freeSlots_.pop_back();
+            table_[index] = p;
         } else {
-            processes[processIdx].completionTime = currentTime;
-            processes[processIdx].turnaroundTime = processes[processIdx].completionTime - processes[processIdx].arrivalTime;
-            processes[processIdx].waitingTime = processes[processIdx].turnaroundTime - processes[processIdx].burstTime;
-            completed++;
+            index = table_.size();
+            table_.push_back(p);
+        }
+        ready_.push(index, clock_);
+        IntervalStats& now = ring_[slot_];
+        now.maxQueue = max(now.maxQueue, ready_.size());
+    }
+
+    // Input has ended: run until every admitted process has finished
+    void drain() {
+        while (running_ || !ready_.empty()) advanceTo(nextPublish_);
+    }
+
+    void printSummary() const {
+        cout << "Summary: processes=" << arrived_ << " late=" << late_ << " end=" << lastCompletion_
+             << fixed << setprecision(2)
+             << " avg_waiting=" << (finished_ ? (double)waitTotal_ / finished_ : 0.0)
+             << " avg_turnaround=" << (finished_ ? (double)turnaroundTotal_ / finished_ : 0.0)
+             << " wait_p50=" << waits_.percentile(0.50)
+             << " wait_p90=" << waits_.percentile(0.90)
+             << " wait_p99=" << waits_.percentile(0.99)
+             << " utilization=" << (lastCompletion_ ? (double)busyTotal_ / lastCompletion_ : 0.0);
+        if (withDeadline_) cout << " deadlines_missed=" << missed_ << "/" << withDeadline_;
+        cout << endl;
+    }
+
+private:
+    // Run the policy until the clock reaches t, publishing at every interval boundary.
+    // Each step ends at the next event: t, a boundary, a completion or a quantum expiry.
+    void advanceTo(long long t) {
+        while (clock_ < t) {
+            // A quantum that expired at the previous event goes behind anything that
+            // arrived then; a preempted process rejoins the queue to be picked again
+            if (sliceExpired_ || preempted_) {
+                ready_.push(current_, clock_);
+                running_ = false;
+                sliceExpired_ = false;
+                preempted_ = false;
+            }
+            if (!running_ && !ready_.empty()) {
+                current_ = ready_.pop(clock_);
+                running_ = true;
+                sliceLeft_ = policy_.quantum;
+                if (table_[current_].pid != lastPid_) dispatch_counter.add();
+                lastPid_ = table_[current_].pid;
+            }
+
+            long long until = min(t, nextPublish_);
+            if (running_) {
+                until = min(until, clock_ + table_[current_].remainingTime);
+                if (policy_.quantum > 0) until = min(until, clock_ + sliceLeft_);
+            }
+            long long step = until - clock_;
+
+            IntervalStats& now = ring_[slot_];
+            now.queueArea += step * ready_.size();
+            if (running_) {
+                now.busy += step;
+                busyTotal_ += step;
+                table_[current_].remainingTime -= step;
+                sliceLeft_ -= step;
+            }
+            clock_ = until;
+            time_units_counter.add(step);
+
+            if (running_ && table_[current_].remainingTime == 0) {
+                finish(table_[current_]);
+                freeSlots_.push_back(current_);
+                running_ = false;
+            } else if (running_ && policy_.quantum > 0 && sliceLeft_ == 0) {
+                sliceExpired_ = true;
+            }
+
+            if (clock_ == nextPublish_) {
+                report();
+                nextPublish_ += interval_;
+                slot_ = (slot_ + 1) % ring_.size();
+                ring_[slot_] = IntervalStats();
+                ring_[slot_].maxQueue = ready_.size();
+            }
+        }
+    }
+
+    void finish(const LiveProcess& p) {
+        long long turnaround = clock_ - p.arrivalTime;
+        long long waiting = turnaround - p.burstTime;
+        IntervalStats& now = ring_[slot_];
+        now.waits.add(waiting);
+        now.completed++;
+        now.waitSum += waiting;
+        waits_.add(waiting);
+        waitTotal_ += waiting;
+        turnaroundTotal_ += turnaround;
+        finished_++;
+        lastCompletion_ = clock_;
+        if (p.deadline != LLONG_MAX) {
+            withDeadline_++;
+            if (clock_ > p.deadline) missed_++;
+        }
+    }
+
+    // One line of metrics over the intervals in the ring, ending at the current time
+    void report() {
+        IntervalStats window;
+        for (const auto& s : ring_) {
+            window.waits.merge(s.waits);
+            window.completed += s.completed;
+            window.waitSum += s.waitSum;
+            window.busy += s.busy;
+            window.queueArea += s.queueArea;
+            window.maxQueue = max(window.maxQueue, s.maxQueue);
+        }
+        long long windowStart = max(0LL, nextPublish_ - interval_ * (long long)ring_.size());
+        long long span = max(1LL, clock_ - windowStart);
+
+        cout << "t=" << clock_ << " completed=" << window.completed << fixed << setprecision(2)
+             << " wait_avg=" << (window.completed ? (double)window.waitSum / window.completed : 0.0)
+             << " wait_p50=" << window.waits.percentile(0.50)
+             << " wait_p90=" << window.waits.percentile(0.90)
+             << " wait_p99=" << window.waits.percentile(0.99)
+             << " queue_now=" << ready_.size()
+             << " queue_avg=" << (double)window.queueArea / span
+             << " queue_max=" << window.maxQueue
+             << " utilization=" << (double)window.busy / span << endl;
+    }
+
+    Policy policy_;
+    vector<LiveProcess> table_; // Processes not yet finished, in slots reused through freeSlots_
+    vector<int> freeSlots_;
+    ReadyQueue<Policy, LiveProcess> ready_;
+    long long interval_;
+    long long clock_ = 0;
+    long long nextPublish_;
+
+    int current_ = 0; // Slot of the running process
+    bool running_ = false;
+    long long sliceLeft_ = 0;
+    bool sliceExpired_ = false;
+    bool preempted_ = false;
+    long long lastPid_ = 0;
+
+    vector<IntervalStats> ring_; // Last W / T intervals, slot_ is the current one
+    size_t slot_ = 0;
+
+    WaitHistogram waits_; // Whole run
+    long long arrived_ = 0;
+    long long late_ = 0;
+    long long finished_ = 0;
+    long long waitTotal_ = 0;
+    long long turnaroundTotal_ = 0;
+    long long busyTotal_ = 0;
+    long long lastCompletion_ = 0;
+    long long withDeadline_ = 0;
+    long long missed_ = 0;
+};
+
+// Feed every arrival line of the stream to a scheduler running the policy
+template <class Policy>
+void streamArrivals(istream& in, Policy policy, long long interval, int windowIntervals) {
+    OnlineScheduler<Policy> scheduler(policy, interval, windowIntervals);
+    string line;
+    long long lineNumber = 0;
+    while (getline(in, line)) {
+        lineNumber++;
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == string::npos || line[first] == '#') continue;
+
+        istringstream fields(line);
+        long long arrival;
+        int burst, priority = 0;
+        long long deadline = LLONG_MAX;
+        if (!(fields >> arrival >> burst) || arrival < 0 || burst < 1) {
+            cerr << "Skipping line " << lineNumber << ": " << line << endl;
+            continue;
+        }
+        if (fields >> priority) fields >> deadline;
+        scheduler.arrive(arrival, burst, priority, deadline);
+    }
+    scheduler.drain();
+    scheduler.printSummary();
+}
+
+int runOnline(int argc, char* argv[]) {
+    prof::Scope timing(online_timer);
+    string path = "-";
+    string policyName = "fcfs";
+    int quantum = 4;
+    unsigned long long seed = 1;
+    long long interval = 100;
+    long long window = 0;
+
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) {
+            path = arg;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            cout << "Missing value for " << arg << endl;
+            return 1;
+        }
+        string value = argv[++i];
+        if (arg == "--policy") policyName = value;
+        else if (arg == "--quantum") quantum = stoi(value);
+        else if (arg == "--seed") seed = stoull(value);
+        else if (arg == "--interval") interval = stoll(value);
+        else if (arg == "--window") window = stoll(value);
+        else {
+            cout << "Unknown option " << arg << endl;
+            return 1;
+        }
+    }
+    if (window == 0) window = interval * 10;
+    if (quantum < 1 || interval < 1 || window < interval) {
+        cout << "Quantum and interval must be positive and the window at least one interval." << endl;
+        return 1;
+    }
+
+    ifstream file;
+    if (path != "-") {
+        file.open(path);
+        if (!file.is_open()) {
+            cout << "Error opening " << path << "." << endl;
+            return 1;
         }
     }
-    cout << " (end at " << currentTime << ")" << endl;
-    printResults(processes, "Round Robin");
+    istream& in = path == "-" ? cin : file;
+    int windowIntervals = (window + interval - 1) / interval;
+
+    if (policyName == "fcfs") streamArrivals(in, FcfsPolicy(), interval, windowIntervals);
+    else if (policyName == "sjf") streamArrivals(in, SjfPolicy(), interval, windowIntervals);
+    else if (policyName == "priority") streamArrivals(in, PriorityPolicy(), interval, windowIntervals);
+    else if (policyName == "rr") streamArrivals(in, RoundRobinPolicy{quantum}, interval, windowIntervals);
+    else if (policyName == "hrrn") streamArrivals(in, HrrnPolicy(), interval, windowIntervals);
+    else if (policyName == "lottery") streamArrivals(in, LotteryPolicy(quantum, seed), interval, windowIntervals);
+    else if (policyName == "edf") streamArrivals(in, EdfPolicy(), interval, windowIntervals);
+    else {
+        cout << "Unknown policy " << policyName << " (use fcfs, sjf, priority, rr, hrrn, lottery or edf)." << endl;
+        return 1;
+    }
+    return 0;
 }
 
+int main(int argc, char* argv[]) {
+    prof::Session session("scheduler");
+    if (argc > 1 && string(argv[1]) == "--online") return runOnline(argc, argv);
 
-int main() {
     int n;
     cout << "Enter the number of processes: ";
     cin >> n;
@@ -242,6 +726,9 @@ int main() {
         cout << "3. Non-Preemptive Priority\n";
         cout << "4. Round Robin (RR)\n";
         cout << "5. Exit\n";
+        cout << "6. Highest Response Ratio Next (HRRN)\n";
+        cout << "7. Lottery\n";
+        cout << "8. Preemptive Earliest Deadline First (EDF)\n";
         cout << "Enter your choice: ";
         cin >> choice;
 
@@ -265,6 +752,27 @@ int main() {
             case 5:
                 cout << "Exiting...\n";
                 break;
+            case 6:
+                hrrn(processes);
+                break;
+            case 7: {
+                int timeQuantum;
+                unsigned long long seed;
+                cout << "Enter Time Quantum for Lottery: ";
+                cin >> timeQuantum;
+                cout << "Enter random seed: ";
+                cin >> seed;
+                lottery(processes, timeQuantum, seed);
+                break;
+            }
+            case 8:
+                cout << "Enter the deadline of each process:\n";
+                for (auto& p : processes) {
+                    cout << "Process " << p.pid << ": ";
+                    cin >> p.deadline;
+                }
+                edf(processes);
+                break;
             default:
                 cout << "Invalid choice! Please try again.\n";
         }
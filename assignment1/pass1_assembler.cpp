@@ -6,6 +6,12 @@
 #include <vector>
 #include <sstream>
 #include <map>
+#include <string_view>
+#include <algorithm>
+#include <functional>
+
+#include "../common/line_map.h"
+#include "../common/profiler.h"
 
 using namespace std;
 
@@ -41,6 +47,119 @@ void initialize_optab() {
     OPTAB["DS"] = {"02", "DS"};
 }
 
+// Bump-allocated storage for symbol and literal text. Tables refer to text by
+// offset rather than pointer, so the arena can grow without invalidating them.
+class StringArena {
+public:
+    uint32_t add(string_view s) {
+        uint32_t offset = data_.size();
+        data_.insert(data_.end(), s.begin(), s.end());
+        return offset;
+    }
+
+    string_view view(uint32_t offset, uint32_t length) const {
+        return string_view(data_.data() + offset, length);
+    }
+
+private:
+    vector<char> data_;
+};
+
+// Symbol Table (SYMTAB): records live contiguously in definition order, with
+// an open-addressed index of record numbers on top for lookups by name
+struct SymbolRecord {
+    uint32_t offset;
+    uint32_t length;
+    uint32_t hash;
+    int address;
+};
+
+class SymbolTable {
+public:
+    explicit SymbolTable(StringArena& arena) : arena_(arena), slots_(1024, EMPTY) {}
+
+    // Address of name, or nullptr if it is not in the table
+    int* find(string_view name) {
+        uint32_t slot = locate(name, hash_of(name));
+        return slots_[slot] == EMPTY ? nullptr : &records_[slots_[slot]].address;
+    }
+
+    // Address of name, adding it with the given address if it is new
+    int& insert(string_view name, int address, bool& inserted) {
+        uint32_t hash = hash_of(name);
+        uint32_t slot = locate(name, hash);
+        inserted = (slots_[slot] == EMPTY);
+        if (inserted) {
+            slots_[slot] = records_.size();
+            records_.push_back({arena_.add(name), (uint32_t)name.size(), hash, address});
+            if (records_.size() * 2 > slots_.size()) grow();
+            return records_.back().address;
+        }
+        return records_[slots_[slot]].address;
+    }
+
+    string_view name(const SymbolRecord& r) const { return arena_.view(r.offset, r.length); }
+
+    // Records ordered by name, for writing symtab.txt
+    vector<const SymbolRecord*> sorted() const {
+        vector<const SymbolRecord*> order;
+        order.reserve(records_.size());
+        for (const auto& r : records_) order.push_back(&r);
+        sort(order.begin(), order.end(), [this](const SymbolRecord* a, const SymbolRecord* b) {
+            return name(*a) < name(*b);
+        });
+        return order;
+    }
+
+private:
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    static uint32_t hash_of(string_view name) { return (uint32_t)hash<string_view>()(name); }
+
+    // Slot holding name, or the empty slot where it would go
+    uint32_t locate(string_view name, uint32_t hash) const {
+        uint32_t mask = slots_.size() - 1;
+        uint32_t slot = hash & mask;
+        while (slots_[slot] != EMPTY) {
+            const SymbolRecord& r = records_[slots_[slot]];
+            if (r.hash == hash && arena_.view(r.offset, r.length) == name) break;
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+
+    void grow() {
+        slots_.assign(slots_.size() * 2, EMPTY);
+        uint32_t mask = slots_.size() - 1;
+        for (uint32_t i = 0; i < records_.size(); ++i) {
+            uint32_t slot = records_[i].hash & mask;
+            while (slots_[slot] != EMPTY) slot = (slot + 1) & mask;
+            slots_[slot] = i;
+        }
+    }
+
+    StringArena& arena_;
+    vector<SymbolRecord> records_;
+    vector<uint32_t> slots_;
+};
+
+// Literal Table (LITTAB) entry; the literal's text (e.g. ='5') lives in the arena
+struct LiteralRecord {
+    uint32_t offset;
+    uint32_t length;
+    int address;
+};
+
+// Profiling hooks, reported when SPOS_PROFILE is set
+prof::Timer tokenize_timer("tokenize");
+prof::Timer literal_pool_timer("literal_pool");
+prof::Timer write_timer("write_output");
+prof::Counter lines_counter("lines");
+prof::Counter optab_lookups("optab_lookups");
+prof::Counter symtab_lookups("symtab_lookups");
+prof::Counter literals_counter("literals");
+prof::Counter bytes_written("bytes_written");
+
 // Helper to check if a string is a number
 bool is_number(const string& s) {
     return !s.empty() && s.find_first_not_of("0123456789") == string::npos;
@@ -48,11 +167,13 @@ bool is_number(const string& s) {
 
 
 int main() {
+    prof::Session session("assembler_pass1");
     initialize_optab();
 
     // Data structures for Pass 1
-    map<string, int> SYMTAB;
-    vector<pair<string, int>> LITTAB;
+    StringArena arena;
+    SymbolTable SYMTAB(arena);
+    vector<LiteralRecord> LITTAB;
     vector<int> POOLTAB;
     POOLTAB.push_back(0); // First pool starts at index 0 of LITTAB
 
@@ -70,17 +191,30 @@ int main() {
         return 1;
     }
 
-    string line;
-    while (getline(inputFile, line)) {
-        stringstream ss(line);
-        string word;
+    // LC at the end of every IC line, i.e. the address pass 2 gives the word
+    // that line turns into
+    vector<int> ic_addresses;
+    auto end_line = [&](ostream& ic) {
+        ic << endl;
+        ic_addresses.push_back(lc);
+    };
+
+    // Assemble one source line, writing its intermediate code to ic
+    auto assemble_line = [&](const string& line, ostream& ic) {
         vector<string> tokens;
-        while (ss >> word) {
-            tokens.push_back(word);
+        {
+            prof::Scope timing(tokenize_timer);
+            stringstream ss(line);
+            string word;
+            while (ss >> word) {
+                tokens.push_back(word);
+            }
         }
+        lines_counter.add();
 
         string label = "", mnemonic = "", op1 = "", op2 = "";
         bool hasLabel = (OPTAB.find(tokens[0]) == OPTAB.end());
+        optab_lookups.add();
 
         if (hasLabel) {
             label = tokens[0];
@@ -95,106 +229,148 @@ int main() {
 
         // 1. Handle Label
         if (!label.empty()) {
-            if (SYMTAB.find(label) == SYMTAB.end()) {
-                SYMTAB[label] = lc;
-            } else {
-                // If label is already there, it might be a forward reference updated by EQU
-                // For simplicity, we just update it. A real assembler might error on re-definition.
-                if (mnemonic != "EQU") {
-                     SYMTAB[label] = lc;
-                }
+            symtab_lookups.add();
+            bool inserted;
+            int& address = SYMTAB.insert(label, lc, inserted);
+            // If label is already there, it might be a forward reference updated by EQU
+            // For simplicity, we just update it. A real assembler might error on re-definition.
+            if (!inserted && mnemonic != "EQU") {
+                 address = lc;
             }
         }
         
         // 2. Process Mnemonic
-        if (OPTAB.find(mnemonic) != OPTAB.end()) {
-            OpcodeInfo info = OPTAB[mnemonic];
+        optab_lookups.add();
+        auto optab_entry = OPTAB.find(mnemonic);
+        if (optab_entry != OPTAB.end()) {
+            const OpcodeInfo& info = optab_entry->second;
             
-            icFile << "(" << info.type << "," << info.opcode << ") ";
+            ic << "(" << info.type << "," << info.opcode << ") ";
 
             if (mnemonic == "START") {
                 lc = stoi(op1);
-                icFile << "(C," << op1 << ")" << endl;
-                continue; // Don't increment lc for START
+                ic << "(C," << op1 << ")";
+                end_line(ic);
+                return; // Don't increment lc for START
             } 
             
             else if (mnemonic == "END" || mnemonic == "LTORG") {
                 // Process literal pool
+                prof::Scope timing(literal_pool_timer);
                 for (int i = littab_ptr; i < LITTAB.size(); ++i) {
-                    LITTAB[i].second = lc;
-                    icFile << "(DL,01) (C," << LITTAB[i].first.substr(2, LITTAB[i].first.length() - 3) << ")" << endl;
+                    LITTAB[i].address = lc;
+                    string_view literal = arena.view(LITTAB[i].offset, LITTAB[i].length);
+                    ic << "(DL,01) (C," << literal.substr(2, literal.length() - 3) << ")";
+                    end_line(ic);
                     lc++;
                 }
                 POOLTAB.push_back(LITTAB.size());
                 littab_ptr = LITTAB.size();
-                if(mnemonic == "END") icFile << endl;
+                if(mnemonic == "END") end_line(ic);
 
             } 
             
             else if (mnemonic == "EQU") {
                 // For simplicity, we handle only simple assignment like 'A EQU B'
                 // A more complex handler would parse expressions like B+5
-                if (SYMTAB.find(op1) != SYMTAB.end()) {
-                    SYMTAB[label] = SYMTAB[op1];
-                } else {
-                    // Handle forward reference if needed, or assume defined
-                    SYMTAB[label] = 0; // Or some error indicator
-                }
-                icFile << "(S," << op1 << ")" << endl;
-                continue; // No LC increment for EQU
+                symtab_lookups.add();
+                int* value = SYMTAB.find(op1);
+                // Handle forward reference if needed, or assume defined
+                int address = value ? *value : 0; // Or some error indicator
+                bool inserted;
+                SYMTAB.insert(label, address, inserted) = address;
+                ic << "(S," << op1 << ")";
+                end_line(ic);
+                return; // No LC increment for EQU
             } 
             
             else if (mnemonic == "DS") {
                 int size = stoi(op1);
-                icFile << "(C," << size << ")" << endl;
+                ic << "(C," << size << ")";
+                end_line(ic);
                 lc += size;
-                continue;
+                return;
             } 
             
             else if (mnemonic == "DC") {
-                icFile << "(C," << op1 << ")" << endl;
+                ic << "(C," << op1 << ")";
+                end_line(ic);
             } 
             
             else { // It's an Imperative Statement (IS)
                 if (!op1.empty()) {
-                    if (op1 == "AREG") icFile << "(1) ";
-                    else if (op1 == "BREG") icFile << "(2) ";
-                    else if (op1 == "CREG") icFile << "(3) ";
+                    if (op1 == "AREG") ic << "(1) ";
+                    else if (op1 == "BREG") ic << "(2) ";
+                    else if (op1 == "CREG") ic << "(3) ";
                     else { // It's a symbol
-                        if (SYMTAB.find(op1) == SYMTAB.end()) {
-                            SYMTAB[op1] = -1; // Forward reference
-                        }
-                        icFile << "(S," << op1 << ") ";
+                        symtab_lookups.add();
+                        bool inserted;
+                        SYMTAB.insert(op1, -1, inserted); // Forward reference if new
+                        ic << "(S," << op1 << ") ";
                     }
                 }
                 if (!op2.empty()) {
                     if (op2.rfind("='", 0) == 0) { // It's a literal
-                        LITTAB.push_back({op2, -1});
-                        icFile << "(L," << LITTAB.size()-1 << ")";
+                        LITTAB.push_back({arena.add(op2), (uint32_t)op2.size(), -1});
+                        literals_counter.add();
+                        ic << "(L," << LITTAB.size()-1 << ")";
                     } else { // It's a symbol
-                         if (SYMTAB.find(op2) == SYMTAB.end()) {
-                            SYMTAB[op2] = -1; // Forward reference
-                        }
-                        icFile << "(S," << op2 << ")";
+                         symtab_lookups.add();
+                         bool inserted;
+                         SYMTAB.insert(op2, -1, inserted); // Forward reference if new
+                        ic << "(S," << op2 << ")";
                     }
                 }
-                icFile << endl;
+                end_line(ic);
             }
             lc++;
         }
+    };
+
+    // Source location of every ic.txt line
+    line_map::Table icMap;
+    line_map::Upstream source(icMap, "input.txt");
+    uint32_t line_no = 0, ic_line = 0;
+    ostringstream icLine;
+
+    string line;
+    while (getline(inputFile, line)) {
+        line_no++;
+        icLine.str("");
+        ic_addresses.clear();
+        assemble_line(line, icLine);
+
+        // A source line can produce several IC lines (LTORG/END emit the literal pool)
+        for (int address : ic_addresses) {
+            icMap.add(++ic_line, source.at(line_no));
+            icMap.add_address(ic_line, address);
+        }
+        string ic = icLine.str();
+        prof::Scope timing(write_timer);
+        icFile << ic;
     }
     
     // Write tables to files
-for (auto const& pair : SYMTAB) {
-    symtabFile << pair.first << " " << pair.second << endl;
+    {
+    prof::Scope timing(write_timer);
+for (const SymbolRecord* r : SYMTAB.sorted()) {
+    symtabFile << SYMTAB.name(*r) << " " << r->address << '\n';
 }
 
 for (size_t i = 0; i < LITTAB.size(); ++i) {
-    littabFile << LITTAB[i].first << " " << LITTAB[i].second << endl;
+    littabFile << arena.view(LITTAB[i].offset, LITTAB[i].length) << " " << LITTAB[i].address << '\n';
 }
 for (int index : POOLTAB) {
-    pooltabFile << index << endl;
+    pooltabFile << index << '\n';
 }
+    }
+    bytes_written.add((streamoff)icFile.tellp() + (streamoff)symtabFile.tellp() +
+                      (streamoff)littabFile.tellp() + (streamoff)pooltabFile.tellp());
+
+    if (!icMap.save("ic.lmap", icFile.tellp())) {
+        cout << "Error writing line map file." << endl;
+        return 1;
+    }
 
     inputFile.close();
     icFile.close();
@@ -203,7 +379,7 @@ for (int index : POOLTAB) {
     pooltabFile.close();
 
     cout << "Pass 1 finished successfully." << endl;
-    cout << "Check ic.txt, symtab.txt, littab.txt, and pooltab.txt" << endl;
+    cout << "Check ic.txt, symtab.txt, littab.txt, and pooltab.txt (line map in ic.lmap)" << endl;
 
     return 0;
 }
\ No newline at end of file
@@ -7,8 +7,20 @@
 #include <sstream>
 #include <map>
 
+#include "../common/line_map.h"
+#include "../common/profiler.h"
+
 using namespace std;
 
+// Profiling hooks, reported when SPOS_PROFILE is set
+prof::Timer load_tables_timer("load_tables");
+prof::Timer parse_timer("parse");
+prof::Counter lines_counter("lines");
+prof::Counter symtab_lookups("symtab_lookups");
+prof::Counter littab_lookups("littab_lookups");
+prof::Counter words_counter("words_emitted");
+prof::Counter bytes_written("bytes_written");
+
 // Helper to load Symbol Table from file
 void load_symtab(map<string, int>& symtab) {
     ifstream symtabFile("symtab.txt");
@@ -32,11 +44,15 @@ void load_littab(vector<pair<string, int>>& littab) {
 }
 
 int main() {
+    prof::Session session("assembler_pass2");
     map<string, int> SYMTAB;
     vector<pair<string, int>> LITTAB;
 
-    load_symtab(SYMTAB);
-    load_littab(LITTAB);
+    {
+        prof::Scope timing(load_tables_timer);
+        load_symtab(SYMTAB);
+        load_littab(LITTAB);
+    }
 
     ifstream icFile("ic.txt");
     ofstream machineCodeFile("machine_code.txt");
@@ -46,22 +62,33 @@ int main() {
         return 1;
     }
 
+    // Source of every machine code word, keyed by the address pass 1 recorded
+    // for its IC line in ic.lmap
+    line_map::Table machineCodeMap;
+    line_map::Upstream source(machineCodeMap, "ic.txt");
+    uint32_t ic_line = 0;
+    uint64_t address;
+
     string line;
-    int lc = 0;
 
     while (getline(icFile, line)) {
+        ic_line++;
+        lines_counter.add();
         stringstream ss(line);
         string token;
         vector<string> tokens;
         
         // Simple parser for the intermediate code format (e.g., "(IS,04) (1) (S,A)")
         // This is a basic parser and can be made more robust
-        size_t pos = 0;
-        string temp_line = line;
-        while ((pos = temp_line.find('(')) != string::npos) {
-            size_t end_pos = temp_line.find(')');
-            tokens.push_back(temp_line.substr(pos + 1, end_pos - pos - 1));
-            temp_line.erase(0, end_pos + 2); // +2 to remove ')' and space
+        {
+            prof::Scope timing(parse_timer);
+            size_t pos = 0;
+            string temp_line = line;
+            while ((pos = temp_line.find('(')) != string::npos) {
+                size_t end_pos = temp_line.find(')');
+                tokens.push_back(temp_line.substr(pos + 1, end_pos - pos - 1));
+                temp_line.erase(0, end_pos + 2); // +2 to remove ')' and space
+            }
         }
         
         if (tokens.empty()) continue;
@@ -85,28 +112,41 @@ int main() {
                 string op_value = tokens[2].substr(tokens[2].find(',') + 1);
 
                 if (op_type == "S") {
+                    symtab_lookups.add();
                     machineCodeFile << SYMTAB[op_value] << endl;
                 } else if (op_type == "L") {
+                    littab_lookups.add();
                     machineCodeFile << LITTAB[stoi(op_value)].second << endl;
                 }
             } else {
                  machineCodeFile << "000" << endl; // For instructions like STOP
             }
+            if (source.address(ic_line, address)) machineCodeMap.add(address, source.at(ic_line));
+            words_counter.add();
         } 
         
         else if (class_type == "DL" && opcode == "01") { // DC - Declare Constant
             string value = tokens[1].substr(tokens[1].find(',') + 1);
             machineCodeFile << "+ 00 0 00" << value << endl;
+            if (source.address(ic_line, address)) machineCodeMap.add(address, source.at(ic_line));
+            words_counter.add();
         } 
         
         // AD and DS (except DC) do not generate machine code, so we ignore them.
     }
 
+    if (!machineCodeMap.save("machine_code.lmap", machineCodeFile.tellp())) {
+        cout << "Error writing line map file." << endl;
+        return 1;
+    }
+
+    bytes_written.add((streamoff)machineCodeFile.tellp());
+
     icFile.close();
     machineCodeFile.close();
 
     cout << "Pass 2 finished successfully." << endl;
-    cout << "Check machine_code.txt for the output." << endl;
+    cout << "Check machine_code.txt for the output (line map in machine_code.lmap)." << endl;
 
     return 0;
 }
\ No newline at end of file
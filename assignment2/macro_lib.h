@@ -0,0 +1,272 @@
+// macro_lib.h
+//
+// Precompiled macro library shared by both passes of the macro processor.
+// Pass 1 writes the MNT and MDT into a single binary file (macro_lib.bin)
+// next to mnt.txt/mdt.txt; pass 2 maps that file into memory and uses it
+// directly, so its startup cost does not depend on how many macros the
+// library holds. The header records the sizes of mnt.txt and mdt.txt, and
+// pass 2 falls back to the text tables when they no longer match or are
+// newer than the image.
+//
+// File layout (all integers are little-endian uint32_t):
+//
+//   header   magic "SPOSMLB\0", version, mnt_count, bucket_count,
+//            mdt_count, strings_size, mnt_text_size, mdt_text_size
+//   buckets  bucket_count x {name_offset, name_length, mdt_index, hash}
+//            open-addressed MNT, empty slot has name_length == 0
+//   mdt      (mdt_count + 1) offsets into the string blob, line i is
+//            [mdt[i], mdt[i + 1])
+//   strings  macro names and MDT lines, not NUL-terminated
+//
+// Offsets are checked when they are used rather than when the file is
+// mapped, so a damaged image cannot make a lookup read outside it.
+
+#ifndef MACRO_LIB_H
+#define MACRO_LIB_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace macro_lib {
+
+const char MAGIC[8] = {'S', 'P', 'O', 'S', 'M', 'L', 'B', '\0'};
+const uint32_t VERSION = 2;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t mnt_count;
+    uint32_t bucket_count;
+    uint32_t mdt_count;
+    uint32_t strings_size;
+    uint32_t mnt_text_size; // sizes of mnt.txt and mdt.txt when the image was built
+    uint32_t mdt_text_size;
+};
+
+struct Bucket {
+    uint32_t name_offset;
+    uint32_t name_length;
+    uint32_t mdt_index;
+    uint32_t hash;
+};
+
+// FNV-1a, so the on-disk table does not depend on the standard library's hash
+inline uint32_t hash_name(std::string_view name) {
+    uint32_t h = 2166136261u;
+    for (unsigned char c : name) {
+        h ^= c;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Build the library image from the tables produced by pass 1. The text sizes
+// are those of the mnt.txt/mdt.txt written alongside it, or 0 for an image
+// that is only used in memory.
+inline std::vector<char> build(const std::vector<std::pair<std::string, int>>& mnt,
+                               const std::vector<std::string>& mdt,
+                               uint32_t mnt_text_size = 0, uint32_t mdt_text_size = 0) {
+    // Keep the table at most half full so probe chains stay short
+    uint32_t bucket_count = 1;
+    while (bucket_count < mnt.size() * 2) bucket_count <<= 1;
+
+    std::string strings;
+    std::vector<Bucket> buckets(bucket_count, Bucket{0, 0, 0, 0});
+    for (const auto& entry : mnt) {
+        uint32_t h = hash_name(entry.first);
+        uint32_t slot = h & (bucket_count - 1);
+        bool redefined = false;
+        while (buckets[slot].name_length != 0) {
+            const Bucket& b = buckets[slot];
+            if (b.hash == h && strings.compare(b.name_offset, b.name_length, entry.first) == 0) {
+                redefined = true; // a later definition replaces the earlier one
+                break;
+            }
+            slot = (slot + 1) & (bucket_count - 1);
+        }
+        if (redefined) {
+            buckets[slot].mdt_index = entry.second;
+            continue;
+        }
+        buckets[slot] = {(uint32_t)strings.size(), (uint32_t)entry.first.size(),
+                         (uint32_t)entry.second, h};
+        strings += entry.first;
+    }
+
+    std::vector<uint32_t> offsets;
+    offsets.reserve(mdt.size() + 1);
+    for (const auto& line : mdt) {
+        offsets.push_back(strings.size());
+        strings += line;
+    }
+    offsets.push_back(strings.size());
+
+    Header header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.mnt_count = mnt.size();
+    header.bucket_count = bucket_count;
+    header.mdt_count = mdt.size();
+    header.strings_size = strings.size();
+    header.mnt_text_size = mnt_text_size;
+    header.mdt_text_size = mdt_text_size;
+
+    std::vector<char> image(sizeof(Header) + bucket_count * sizeof(Bucket) +
+                            offsets.size() * sizeof(uint32_t) + strings.size());
+    char* p = image.data();
+    memcpy(p, &header, sizeof(Header));
+    p += sizeof(Header);
+    memcpy(p, buckets.data(), bucket_count * sizeof(Bucket));
+    p += bucket_count * sizeof(Bucket);
+    memcpy(p, offsets.data(), offsets.size() * sizeof(uint32_t));
+    p += offsets.size() * sizeof(uint32_t);
+    memcpy(p, strings.data(), strings.size());
+    return image;
+}
+
+// Read-only view over a library image, either mapped from disk or built in memory
+class Library {
+public:
+    Library() = default;
+    Library(const Library&) = delete;
+    Library& operator=(const Library&) = delete;
+
+    ~Library() {
+        if (mapped_) munmap((void*)base_, size_);
+    }
+
+    // Map a library file; returns false if it is missing, not a valid image,
+    // or out of date with respect to the text tables it was built from
+    bool map_file(const char* path, const char* mnt_path, const char* mdt_path) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Header)) {
+            close(fd);
+            return false;
+        }
+        void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) return false;
+
+        if (!attach((const char*)addr, st.st_size) ||
+            !matches_text(mnt_path, header_.mnt_text_size, st) ||
+            !matches_text(mdt_path, header_.mdt_text_size, st)) {
+            munmap(addr, st.st_size);
+            return false;
+        }
+        mapped_ = true;
+        return true;
+    }
+
+    // Take ownership of an image built with build()
+    bool adopt(std::vector<char> image) {
+        owned_ = std::move(image);
+        return attach(owned_.data(), owned_.size());
+    }
+
+    // MDT index of the macro's prototype line, or -1 if name is not a macro
+    int find(std::string_view name) const {
+        if (bucket_count_ == 0) return -1;
+        uint32_t h = hash_name(name);
+        uint32_t slot = h & (bucket_count_ - 1);
+        for (uint32_t probes = 0; probes < bucket_count_ && buckets_[slot].name_length != 0; ++probes) {
+            const Bucket& b = buckets_[slot];
+            if (b.hash == h && b.name_length == name.size() && b.name_length <= strings_size_ &&
+                b.name_offset <= strings_size_ - b.name_length &&
+                memcmp(strings_ + b.name_offset, name.data(), name.size()) == 0) {
+                return b.mdt_index < mdt_count_ ? (int)b.mdt_index : -1;
+            }
+            slot = (slot + 1) & (bucket_count_ - 1);
+        }
+        return -1;
+    }
+
+    size_t mdt_size() const { return mdt_count_; }
+
+    // Line i of the MDT, or an empty line if its offsets are out of range
+    std::string_view mdt_line(size_t i) const {
+        if (i >= mdt_count_ || mdt_[i] > mdt_[i + 1] || mdt_[i + 1] > strings_size_) return {};
+        return std::string_view(strings_ + mdt_[i], mdt_[i + 1] - mdt_[i]);
+    }
+
+private:
+    bool attach(const char* data, size_t size) {
+        if (size < sizeof(Header)) return false;
+        Header header;
+        memcpy(&header, data, sizeof(Header));
+        if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION) {
+            return false;
+        }
+        if (header.bucket_count == 0 || (header.bucket_count & (header.bucket_count - 1)) != 0) {
+            return false;
+        }
+        size_t expected = sizeof(Header) + (size_t)header.bucket_count * sizeof(Bucket) +
+                          ((size_t)header.mdt_count + 1) * sizeof(uint32_t) + header.strings_size;
+        if (size != expected) return false;
+
+        base_ = data;
+        size_ = size;
+        header_ = header;
+        bucket_count_ = header.bucket_count;
+        mdt_count_ = header.mdt_count;
+        strings_size_ = header.strings_size;
+        buckets_ = (const Bucket*)(data + sizeof(Header));
+        mdt_ = (const uint32_t*)(buckets_ + bucket_count_);
+        strings_ = (const char*)(mdt_ + mdt_count_ + 1);
+        return true;
+    }
+
+    // A text table matches if it has the recorded size and was not written
+    // after the image
+    static bool matches_text(const char* path, uint32_t size, const struct stat& image) {
+        struct stat st;
+        if (stat(path, &st) != 0 || st.st_size != (off_t)size) return false;
+        const timespec& text_time = modified(st);
+        const timespec& image_time = modified(image);
+        if (text_time.tv_sec != image_time.tv_sec) return text_time.tv_sec < image_time.tv_sec;
+        return text_time.tv_nsec <= image_time.tv_nsec;
+    }
+
+    static const timespec& modified(const struct stat& st) {
+#ifdef __APPLE__
+        return st.st_mtimespec;
+#else
+        return st.st_mtim;
+#endif
+    }
+
+    const char* base_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::vector<char> owned_;
+
+    Header header_ = {};
+    uint32_t bucket_count_ = 0;
+    uint32_t mdt_count_ = 0;
+    uint32_t strings_size_ = 0;
+    const Bucket* buckets_ = nullptr;
+    const uint32_t* mdt_ = nullptr;
+    const char* strings_ = nullptr;
+};
+
+// Write a library image to disk
+inline bool save(const char* path, const std::vector<char>& image) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) return false;
+    out.write(image.data(), image.size());
+    return (bool)out;
+}
+
+} // namespace macro_lib
+
+#endif
@@ -7,6 +7,10 @@
 #include <sstream>
 #include <map>
 
+#include "macro_lib.h"
+#include "../common/line_map.h"
+#include "../common/profiler.h"
+
 using namespace std;
 
 // Using a struct for MNT entries for clarity
@@ -15,7 +19,18 @@ struct MntEntry {
     int mdt_index;
 };
 
+// Profiling hooks, reported when SPOS_PROFILE is set
+prof::Timer tokenize_timer("tokenize");
+prof::Timer write_tables_timer("write_tables");
+prof::Counter lines_counter("lines");
+prof::Counter macros_counter("macros_defined");
+prof::Counter body_lines_counter("macro_body_lines");
+prof::Counter arg_lookups("arg_lookups");
+prof::Counter bytes_written("bytes_written");
+
 int main() {
+    prof::Session session("macro_pass1");
+
     // Data structures for Pass 1
     vector<MntEntry> MNT;
     vector<string> MDT;
@@ -31,15 +46,26 @@ int main() {
         return 1;
     }
 
+    // Source locations of every intermediate.txt line and MDT line
+    line_map::Table intermediateMap, mdtMap;
+    line_map::Upstream intermediateSource(intermediateMap, "input_macro.txt");
+    line_map::Upstream mdtSource(mdtMap, "input_macro.txt");
+    uint32_t line_no = 0, intermediate_line = 0;
+
     string line;
     bool is_defining_macro = false;
 
     while (getline(inputFile, line)) {
-        stringstream ss(line);
-        string word;
+        line_no++;
+        lines_counter.add();
         vector<string> tokens;
-        while (ss >> word) {
-            tokens.push_back(word);
+        {
+            prof::Scope timing(tokenize_timer);
+            stringstream ss(line);
+            string word;
+            while (ss >> word) {
+                tokens.push_back(word);
+            }
         }
 
         if (tokens.empty()) continue;
@@ -47,6 +73,7 @@ int main() {
         // Check for the start of a macro definition
         if (tokens.size() > 1 && tokens[1] == "MACRO") {
             is_defining_macro = true;
+            macros_counter.add();
             
             // 1. Create MNT entry
             MntEntry mnt_entry;
@@ -66,6 +93,7 @@ int main() {
                 mdt_line += " #" + to_string(i - 2);
             }
             MDT.push_back(mdt_line);
+            mdtMap.add(MDT.size(), mdtSource.at(line_no));
 
             continue; // Skip to the next line of input
         }
@@ -74,6 +102,7 @@ int main() {
         if (tokens[0] == "MEND") {
             is_defining_macro = false;
             MDT.push_back("MEND");
+            mdtMap.add(MDT.size(), mdtSource.at(line_no));
             continue;
         }
 
@@ -87,6 +116,7 @@ int main() {
                 }
 
                 // Replace formal arguments with positional notation (#0, #1, ...)
+                arg_lookups.add();
                 if (arg_list.count(operand)) {
                     mdt_line += " #" + to_string(arg_list[operand]);
                 } else {
@@ -97,14 +127,19 @@ int main() {
                 }
             }
             MDT.push_back(mdt_line);
+            mdtMap.add(MDT.size(), mdtSource.at(line_no));
+            body_lines_counter.add();
         } 
         
         // If not in a macro, write to the intermediate file
         else {
             intermediateFile << line << endl;
+            intermediateMap.add(++intermediate_line, intermediateSource.at(line_no));
         }
     }
 
+    prof::Scope write_timing(write_tables_timer);
+
     // Write MNT to mnt.txt
     for (const auto& entry : MNT) {
         mntFile << entry.name << " " << entry.mdt_index << endl;
@@ -115,13 +150,35 @@ int main() {
         mdtFile << def_line << endl;
     }
 
+    // Write the precompiled MNT/MDT that pass 2 maps at startup. The text
+    // tables are flushed first so the library is never older than them.
+    mntFile.flush();
+    mdtFile.flush();
+    vector<pair<string, int>> mnt_pairs;
+    for (const auto& entry : MNT) {
+        mnt_pairs.push_back({entry.name, entry.mdt_index});
+    }
+    if (!macro_lib::save("macro_lib.bin", macro_lib::build(mnt_pairs, MDT, mntFile.tellp(), mdtFile.tellp()))) {
+        cout << "Error writing macro library file." << endl;
+        return 1;
+    }
+
+    if (!intermediateMap.save("intermediate.lmap", intermediateFile.tellp()) ||
+        !mdtMap.save("mdt.lmap", mdtFile.tellp())) {
+        cout << "Error writing line map files." << endl;
+        return 1;
+    }
+
+    bytes_written.add((streamoff)mntFile.tellp() + (streamoff)mdtFile.tellp() +
+                      (streamoff)intermediateFile.tellp());
+
     inputFile.close();
     mntFile.close();
     mdtFile.close();
     intermediateFile.close();
 
     cout << "Pass 1 of Macro Processor finished successfully." << endl;
-    cout << "Check mnt.txt, mdt.txt, and intermediate.txt" << endl;
+    cout << "Check mnt.txt, mdt.txt, macro_lib.bin and intermediate.txt (line maps in *.lmap)" << endl;
 
     return 0;
 }
\ No newline at end of file
@@ -3,25 +3,41 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <sstream>
-#include <map>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "macro_lib.h"
+#include "../common/line_map.h"
+#include "../common/profiler.h"
 
 using namespace std;
 
-// Struct to hold MNT data
-struct MntEntry {
-    string name;
-    int mdt_index;
-};
+// Profiling hooks, reported when SPOS_PROFILE is set
+prof::Timer load_library_timer("load_library");
+prof::Timer expand_timer("expand");
+prof::Timer write_timer("write_output");
+prof::Timer line_map_timer("line_map");
+prof::Timer write_map_timer("write_line_map");
+prof::Counter lines_counter("lines");
+prof::Counter mnt_lookups("mnt_lookups");
+prof::Counter expansions_counter("expansions");
+prof::Counter substitutions_counter("arguments_substituted");
+prof::Counter bytes_written("bytes_written");
 
 // Function to load MNT from file
-void load_mnt(map<string, int>& mnt) {
+void load_mnt(vector<pair<string, int>>& mnt) {
     ifstream mntFile("mnt.txt");
     string name;
     int index;
     while (mntFile >> name >> index) {
-        mnt[name] = index;
+        mnt.push_back({name, index});
     }
     mntFile.close();
 }
@@ -36,82 +52,434 @@ void load_mdt(vector<string>& mdt) {
     mdtFile.close();
 }
 
-int main() {
-    map<string, int> MNT;
-    vector<string> MDT;
+// Map the precompiled library written by pass 1; fall back to the text
+// tables if it is missing, was written by a different version, or no longer
+// matches mnt.txt/mdt.txt
+bool load_library(macro_lib::Library& lib) {
+    if (lib.map_file("macro_lib.bin", "mnt.txt", "mdt.txt")) return true;
 
+    vector<pair<string, int>> MNT;
+    vector<string> MDT;
     load_mnt(MNT);
     load_mdt(MDT);
+    return lib.adopt(macro_lib::build(MNT, MDT));
+}
 
-    ifstream intermediateFile("intermediate.txt");
-    ofstream expandedFile("expanded_code.txt");
-
-    if (!intermediateFile.is_open()) {
-        cout << "Error opening intermediate file." << endl;
-        return 1;
+// Split a line into whitespace-separated words, the same way `ss >> word` does
+void split_words(string_view line, vector<string_view>& words) {
+    words.clear();
+    size_t i = 0;
+    while (i < line.size()) {
+        while (i < line.size() && isspace((unsigned char)line[i])) i++;
+        size_t start = i;
+        while (i < line.size() && !isspace((unsigned char)line[i])) i++;
+        if (i > start) words.push_back(line.substr(start, i - start));
     }
+}
 
-    string line;
-    while (getline(intermediateFile, line)) {
-        stringstream ss(line);
-        string word;
-        vector<string> tokens;
-        while (ss >> word) {
-            tokens.push_back(word);
-        }
+// Where one output line came from: input line (1-based within its chunk) and,
+// for expanded lines, the MDT line and the macro's prototype line
+struct Origin {
+    uint32_t input_line;
+    uint32_t mdt_index;
+    uint32_t proto_index;
+};
+
+const uint32_t COPIED = UINT32_MAX;
 
+// Output of one chunk of input
+struct ChunkResult {
+    string text;
+    vector<Origin> origins;
+    uint32_t input_lines = 0;
+    string map; // block of expanded_code.lmap for the chunk
+};
+
+// Expand every line in [begin, end) into result.
+// Only reads the library, so any number of chunks can be expanded at once.
+void expand_chunk(const macro_lib::Library& lib, const char* begin, const char* end, ChunkResult& result) {
+    prof::Scope timing(expand_timer);
+    uint64_t lookups = 0, expansions = 0, substitutions = 0;
+
+    string& out = result.text;
+    vector<string_view> tokens;
+    vector<string_view> actual_args;
+    vector<string_view> mdt_words;
+
+    const char* p = begin;
+    while (p < end) {
+        const char* nl = (const char*)memchr(p, '\n', end - p);
+        const char* line_end = nl ? nl : end;
+        string_view line(p, line_end - p);
+        p = nl ? nl + 1 : end;
+        uint32_t line_no = ++result.input_lines;
+
+        split_words(line, tokens);
         if (tokens.empty()) continue;
 
         // Check if the first token is a macro name in our MNT
-        if (MNT.count(tokens[0])) {
-            // It's a macro call, so expand it
-            int mdt_start_index = MNT[tokens[0]];
-            
-            // Create a list of the actual arguments from the call
-            vector<string> actual_args;
-            for (size_t i = 1; i < tokens.size(); ++i) {
-                if (tokens[i].back() == ',') {
-                    tokens[i].pop_back();
-                }
-                actual_args.push_back(tokens[i]);
+        int mdt_start_index = lib.find(tokens[0]);
+        lookups++;
+        if (mdt_start_index < 0) {
+            // Not a macro call, so just copy the line to the output
+            out.append(line.data(), line.size());
+            out += '\n';
+            result.origins.push_back({line_no, COPIED, 0});
+            continue;
+        }
+
+        // It's a macro call, so collect the actual arguments without trailing commas
+        expansions++;
+        actual_args.clear();
+        for (size_t i = 1; i < tokens.size(); ++i) {
+            string_view arg = tokens[i];
+            if (arg.back() == ',') arg.remove_suffix(1);
+            actual_args.push_back(arg);
+        }
+
+        // Start expanding from the line after the macro prototype in MDT
+        for (size_t i = mdt_start_index + 1; i < lib.mdt_size(); ++i) {
+            string_view mdt_line = lib.mdt_line(i);
+            if (mdt_line == "MEND") {
+                break; // Stop expanding when we hit MEND
             }
 
-            // Start expanding from the line after the macro prototype in MDT
-            for (int i = mdt_start_index + 1; i < MDT.size(); ++i) {
-                string mdt_line = MDT[i];
-                if (mdt_line == "MEND") {
-                    break; // Stop expanding when we hit MEND
-                }
+            // Substitute positional arguments (#0, #1) with actual arguments
+            split_words(mdt_line, mdt_words);
+            for (size_t w = 0; w < mdt_words.size(); ++w) {
+                string_view word = mdt_words[w];
+                if (w > 0) out += ' ';
 
-                // Substitute positional arguments (#0, #1) with actual arguments
-                stringstream mdt_ss(mdt_line);
-                string mdt_word;
-                string expanded_line = "";
-                
-                mdt_ss >> mdt_word; // Get the instruction
-                expanded_line += mdt_word;
-
-                while(mdt_ss >> mdt_word) { // Get the operands
-                    if (mdt_word[0] == '#') {
-                        int arg_index = stoi(mdt_word.substr(1));
-                        expanded_line += " " + actual_args[arg_index];
-                    } else {
-                        expanded_line += " " + mdt_word;
+                size_t arg_index = 0;
+                size_t digits = 1;
+                if (w > 0 && word[0] == '#') {
+                    while (digits < word.size() && isdigit((unsigned char)word[digits])) {
+                        arg_index = arg_index * 10 + (word[digits] - '0');
+                        digits++;
                     }
                 }
-                expandedFile << expanded_line << endl;
+                if (digits > 1 && arg_index < actual_args.size()) {
+                    out.append(actual_args[arg_index].data(), actual_args[arg_index].size());
+                    substitutions++;
+                } else {
+                    out.append(word.data(), word.size());
+                }
+            }
+            out += '\n';
+            result.origins.push_back({line_no, (uint32_t)i, (uint32_t)mdt_start_index});
+        }
+    }
+
+    lines_counter.add(result.input_lines);
+    mnt_lookups.add(lookups);
+    expansions_counter.add(expansions);
+    substitutions_counter.add(substitutions);
+}
+
+// Writes expanded_code.lmap. Each chunk is mapped and encoded as a block of
+// its own, possibly on a worker thread, and the blocks are streamed to the
+// file in output order, so only the chunks in flight are ever held.
+// Copied lines keep their intermediate.txt location; expanded lines point at
+// the macro body line with the call site pushed onto their macro call chain,
+// and give the call's intermediate.txt line as the input they came from.
+struct ExpansionMap {
+    line_map::Upstream calls{"intermediate.txt"};
+    line_map::Upstream bodies{"mdt.txt"};
+    line_map::Writer file;
+
+    // Encode chunk.map from its origins, which are then released. lines_before
+    // is the number of input lines ahead of the chunk. Safe to run on several
+    // chunks at once.
+    void map_chunk(const macro_lib::Library& lib, uint32_t lines_before, ChunkResult& chunk) const {
+        prof::Scope timing(line_map_timer);
+        line_map::Table map; // keyed by output line within the chunk, from 1
+        line_map::Upstream chunk_calls(map, calls);
+        line_map::Upstream chunk_bodies(map, bodies);
+        unordered_map<uint32_t, uint32_t> macro_names; // prototype MDT index -> string id
+        uint32_t key = 0;
+        uint32_t last_call_line = 0; // input line of the last expanded call and its chain
+        uint32_t last_call_chain = 0;
+
+        for (const Origin& o : chunk.origins) {
+            uint32_t input_line = lines_before + o.input_line;
+            if (o.mdt_index == COPIED) {
+                map.add(++key, chunk_calls.at(input_line));
+                continue;
+            }
+
+            // mdt.lmap is keyed by 1-based mdt.txt line
+            line_map::Location loc = chunk_bodies.at(o.mdt_index + 1);
+            loc.input = input_line;
+            if (input_line == last_call_line) {
+                loc.chain = last_call_chain;
+                map.add(++key, loc);
+                continue;
+            }
+
+            auto it = macro_names.find(o.proto_index);
+            if (it == macro_names.end()) {
+                string_view proto = lib.mdt_line(o.proto_index);
+                string_view name = proto.substr(0, proto.find_first_of(" \t"));
+                it = macro_names.emplace(o.proto_index, map.intern(name)).first;
+            }
+
+            line_map::Location call = chunk_calls.at(input_line);
+            loc.chain = map.frame(it->second, call.file, call.line, call.chain);
+            last_call_line = input_line;
+            last_call_chain = loc.chain;
+            map.add(++key, loc);
+        }
+
+        chunk.map = map.encode_block(key);
+        vector<Origin>().swap(chunk.origins);
+    }
+
+    // Write a mapped chunk's block after the ones already written
+    void append(const ChunkResult& chunk) {
+        prof::Scope timing(write_map_timer);
+        file.write(chunk.map);
+    }
+};
+
+// Write one expanded chunk and its line map block
+void write_chunk(const ChunkResult& chunk, ofstream& expandedFile, ExpansionMap& expansionMap) {
+    {
+        prof::Scope timing(write_timer);
+        expandedFile.write(chunk.text.data(), chunk.text.size());
+        bytes_written.add(chunk.text.size());
+    }
+    expansionMap.append(chunk);
+}
+
+// Read-only mapping of the input file
+struct MappedFile {
+    const char* data = nullptr;
+    size_t size = 0;
+
+    bool open(const char* path) {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return false;
+        }
+        size = st.st_size;
+        if (size > 0) {
+            void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) {
+                close(fd);
+                return false;
             }
+            data = (const char*)addr;
+        }
+        close(fd);
+        return true;
+    }
+
+    // Give back the pages that lie wholly inside [begin, end) once that part has
+    // been read, so a long input does not stay resident behind the expansion
+    void release(const char* begin, const char* end) const {
+        uintptr_t page = sysconf(_SC_PAGESIZE);
+        uintptr_t from = ((uintptr_t)begin + page - 1) / page * page;
+        uintptr_t to = (uintptr_t)end / page * page;
+        if (from < to) madvise((void*)from, to - from, MADV_DONTNEED);
+    }
+
+    ~MappedFile() {
+        if (data) munmap((void*)data, size);
+    }
+};
+
+// Cut the input into pieces of roughly chunk_size bytes that end on a line boundary
+vector<pair<const char*, const char*>> split_chunks(const char* data, size_t size, size_t chunk_size) {
+    vector<pair<const char*, const char*>> chunks;
+    const char* p = data;
+    const char* end = data + size;
+    while (p < end) {
+        const char* cut = end;
+        if ((size_t)(end - p) > chunk_size) {
+            const char* nl = (const char*)memchr(p + chunk_size, '\n', end - p - chunk_size);
+            cut = nl ? nl + 1 : end;
+        }
+        chunks.push_back({p, cut});
+        p = cut;
+    }
+    return chunks;
+}
+
+// Expand and map the chunks on a pool of worker threads and write them out in
+// order. Workers stay at most two chunks per thread ahead of the writer so
+// memory use is bounded. A chunk's map needs the number of input lines before
+// it, which is known once every earlier chunk has been expanded.
+// Output buffers are sized from the expansion ratio of the chunks done so far.
+bool expand_parallel(const macro_lib::Library& lib, const MappedFile& input,
+                     const vector<pair<const char*, const char*>>& chunks, unsigned jobs,
+                     ofstream& expandedFile, ExpansionMap& expansionMap) {
+    size_t n = chunks.size();
+    size_t window = jobs * 2;
+    vector<ChunkResult> outputs(n);
+    vector<char> done(n, 0);
+    vector<uint32_t> chunk_lines(n, 0);
+    vector<uint32_t> lines_before(n + 1, 0);
+    vector<char> counted(n, 0);
+    size_t counted_prefix = 0; // chunks [0, counted_prefix) have known lines_before
+    size_t written = 0;
+    uint64_t bytes_in = 0, bytes_out = 0; // input and output size of the chunks expanded so far
+    atomic<size_t> next(0);
+    mutex m;
+    condition_variable cv;
+
+    auto worker = [&]() {
+        while (true) {
+            size_t i = next.fetch_add(1);
+            if (i >= n) return;
+            size_t in_size = chunks[i].second - chunks[i].first;
+            size_t estimate;
+            {
+                unique_lock<mutex> lock(m);
+                cv.wait(lock, [&] { return i < written + window; });
+                estimate = bytes_in ? in_size * bytes_out / bytes_in + in_size / 16 : in_size;
+            }
+            ChunkResult out;
+            out.text.reserve(estimate);
+            expand_chunk(lib, chunks[i].first, chunks[i].second, out);
+            input.release(chunks[i].first, chunks[i].second);
+            uint32_t before;
+            {
+                unique_lock<mutex> lock(m);
+                bytes_in += in_size;
+                bytes_out += out.text.size();
+                chunk_lines[i] = out.input_lines;
+                counted[i] = 1;
+                while (counted_prefix < n && counted[counted_prefix]) {
+                    lines_before[counted_prefix + 1] = lines_before[counted_prefix] + chunk_lines[counted_prefix];
+                    counted_prefix++;
+                }
+                cv.notify_all();
+                cv.wait(lock, [&] { return counted_prefix >= i; });
+                before = lines_before[i];
+            }
+            expansionMap.map_chunk(lib, before, out);
+            {
+                lock_guard<mutex> lock(m);
+                outputs[i] = std::move(out);
+                done[i] = 1;
+            }
+            cv.notify_all();
+        }
+    };
+
+    vector<thread> pool;
+    for (unsigned t = 0; t < jobs; ++t) {
+        pool.emplace_back(worker);
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        ChunkResult out;
+        {
+            unique_lock<mutex> lock(m);
+            cv.wait(lock, [&] { return done[i] != 0; });
+            out = std::move(outputs[i]);
+        }
+        write_chunk(out, expandedFile, expansionMap);
+        {
+            lock_guard<mutex> lock(m);
+            written = i + 1;
+        }
+        cv.notify_all();
+    }
+
+    for (auto& t : pool) {
+        t.join();
+    }
+    return (bool)expandedFile;
+}
+
+// Parse a -j value: a plain decimal number no larger than MAX_JOBS
+const unsigned MAX_JOBS = 1024;
+bool parse_jobs(const string& text, unsigned& jobs) {
+    if (text.empty()) return false;
+    unsigned value = 0;
+    for (char c : text) {
+        if (!isdigit((unsigned char)c)) return false;
+        value = value * 10 + (c - '0');
+        if (value > MAX_JOBS) return false;
+    }
+    jobs = value;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    prof::Session session("macro_pass2");
+
+    // -j N expands on N threads (0 = one per core); the default is a single thread
+    unsigned jobs = 1;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if ((arg == "-j" || arg == "--jobs") && i + 1 < argc && parse_jobs(argv[++i], jobs)) {
+            if (jobs == 0) jobs = max(1u, thread::hardware_concurrency());
         } else {
-            // Not a macro call, so just copy the line to the output
-            expandedFile << line << endl;
+            cout << "Usage: " << argv[0] << " [-j threads]" << endl;
+            return 1;
+        }
+    }
+
+    macro_lib::Library lib;
+    bool loaded;
+    {
+        prof::Scope timing(load_library_timer);
+        loaded = load_library(lib);
+    }
+    if (!loaded) {
+        cout << "Error loading macro library." << endl;
+        return 1;
+    }
+
+    MappedFile intermediateFile;
+    if (!intermediateFile.open("intermediate.txt")) {
+        cout << "Error opening intermediate file." << endl;
+        return 1;
+    }
+    ofstream expandedFile("expanded_code.txt", ios::binary);
+    ExpansionMap expansionMap;
+    if (!expansionMap.file.open("expanded_code.lmap")) {
+        cout << "Error writing line map file." << endl;
+        return 1;
+    }
+
+    const size_t CHUNK_SIZE = 4 << 20;
+    auto chunks = split_chunks(intermediateFile.data, intermediateFile.size, CHUNK_SIZE);
+
+    if (jobs > 1 && chunks.size() > 1) {
+        expand_parallel(lib, intermediateFile, chunks, min<size_t>(jobs, chunks.size()), expandedFile,
+                        expansionMap);
+    } else {
+        uint32_t lines_before = 0;
+        for (const auto& chunk : chunks) {
+            ChunkResult out;
+            expand_chunk(lib, chunk.first, chunk.second, out);
+            intermediateFile.release(chunk.first, chunk.second);
+            expansionMap.map_chunk(lib, lines_before, out);
+            lines_before += out.input_lines;
+            write_chunk(out, expandedFile, expansionMap);
         }
     }
 
-    intermediateFile.close();
+    if (!expandedFile) {
+        cout << "Error writing expanded code file." << endl;
+        return 1;
+    }
+    uint64_t expanded_size = expandedFile.tellp();
     expandedFile.close();
 
+    if (!expansionMap.file.close(expanded_size)) {
+        cout << "Error writing line map file." << endl;
+        return 1;
+    }
+
     cout << "Pass 2 of Macro Processor finished successfully." << endl;
-    cout << "Check expanded_code.txt for the final output." << endl;
+    cout << "Check expanded_code.txt for the final output (line map in expanded_code.lmap)." << endl;
 
     return 0;
 }
\ No newline at end of file
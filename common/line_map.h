@@ -0,0 +1,820 @@
+// line_map.h
+//
+// Source-location side tables (*.lmap) written next to each generated file.
+// Every stage records, for each line (or machine-code address) it writes,
+// the original file/line it came from and the chain of macro calls that
+// produced it. A stage whose input was itself generated reads the input's
+// map and carries those locations forward, so the map written by the last
+// stage points straight back at the original source. Each key also keeps
+// the line of the stage's own input that produced it, so the steps in
+// between can be followed too: an address leads to its ic.txt line, which
+// ic.lmap leads to the expanded_code.txt line, and so on.
+//
+// Keys are 1-based line numbers for text outputs and addresses for
+// machine_code.lmap. Rows are stored as runs: consecutive keys whose source
+// and input lines each stay the same or advance by one share a single
+// segment, and each
+// segment is delta/varint encoded behind a one-byte flag header. Fields are
+// only written where they differ from a guess: the segment that enters a
+// macro expansion defines its call frame inline, takes the call site to be
+// the line after the last one outside any macro, and expects the same body
+// lines as the previous expansion of that macro. A typical call then costs a
+// flag byte and the macro's id, plus a flag byte for the lines after it.
+//
+// A map can also give each key an address. ic.lmap records the location
+// counter pass 1 had at every intermediate-code line, so pass 2 keys
+// machine_code.lmap by the addresses pass 1 actually assigned instead of
+// working them out again.
+//
+// A map is written as a series of blocks, each with its own strings, frames
+// and predictions, so a stage can encode every chunk of its output as soon as
+// the chunk is done and stream it out instead of holding the whole map until
+// it exits. A trailer records the size of the text file the map describes,
+// so a map left behind after its text file was regenerated or edited is not
+// trusted.
+//
+// File layout:
+//
+//   "SPLM", varint version
+//   per block: varint body size, then the body:
+//     varint key span; keys in the block count from the block's base, which
+//     is the previous block's base plus its span (0 for the first block)
+//     varint string_count, then (varint length, bytes) per string
+//     varint input file: string id + 1, or 0 if the map names no input
+//     varint segment_count, then per segment: flags byte and the fields it
+//     selects, with frame-only records for enclosing frames mixed in
+//     varint address_run_count, then per run: varint key gap, varint
+//     (count - 1) * 2 + step, zigzag address delta
+//   varint 0, then varint text size in bytes
+
+#ifndef LINE_MAP_H
+#define LINE_MAP_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/stat.h>
+
+namespace line_map {
+
+const char MAGIC[4] = {'S', 'P', 'L', 'M'};
+const uint64_t VERSION = 4;
+
+// A position in some source file; chain 0 means "not inside a macro expansion".
+// input is the line of the stage's own input it was produced from, 0 if unknown.
+struct Location {
+    uint32_t file = 0;
+    uint32_t line = 0;
+    uint32_t chain = 0;
+    uint32_t input = 0;
+};
+
+// One level of macro expansion: the macro and the place it was called from.
+// parent is the chain the call itself was in.
+struct Frame {
+    uint32_t macro;
+    uint32_t file;
+    uint32_t line;
+    uint32_t parent;
+};
+
+// keys [key, key + count) map to line, line + step, ... in the same file and
+// chain, and were produced from input lines input, input + input_step, ...
+struct Segment {
+    uint64_t key;
+    uint32_t count;
+    uint32_t file;
+    uint32_t line;
+    uint32_t step;
+    uint32_t chain;
+    uint32_t input;
+    uint32_t input_step;
+
+    uint32_t last_line() const { return line + step * (count - 1); }
+    uint32_t last_input() const { return input + input_step * (count - 1); }
+};
+
+// keys [key, key + count) have addresses address, address + step, ...
+struct AddressRun {
+    uint64_t key;
+    uint32_t count;
+    uint32_t step;
+    uint64_t address;
+
+    uint64_t last_address() const { return address + step * (count - 1); }
+};
+
+// Segment flag bits
+const uint8_t KEY_GAP = 1 << 0;     // varint gap from the previous segment's end follows
+const uint8_t MULTI = 1 << 1;       // varint count - 1 follows, otherwise the guessed count
+const uint8_t STEP = 1 << 2;        // line advances by one per key
+const uint8_t MORE = 1 << 3;        // a second flags byte follows, see below
+const uint8_t CHAIN_SHIFT = 4;      // two bits, see CHAIN_* below
+const uint8_t LINE_DELTA = 1 << 6;  // zigzag delta from the guessed line follows
+const uint8_t CALL_SITE = 1 << 7;   // varint file, zigzag line delta, parent of a new frame follow
+
+const uint8_t CHAIN_SAME = 0;       // same chain as the previous segment
+const uint8_t CHAIN_ROOT = 1;       // chain 0
+const uint8_t CHAIN_NEXT = 2;       // a new frame: varint macro, then its call site if CALL_SITE
+const uint8_t CHAIN_EXPLICIT = 3;   // varint chain follows; with CALL_SITE, a frame-only record
+
+// Second flags byte, for the fields that rarely differ from their guess
+const uint8_t NEW_FILE = 1 << 0;    // varint file follows
+const uint8_t INPUT_DELTA = 1 << 1; // zigzag delta from the guessed input line follows
+const uint8_t INPUT_STEP = 1 << 2;  // the input step is 1 if 0 was guessed, and the other way round
+
+const uint32_t NO_FILE = UINT32_MAX;
+
+inline void put_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out += (char)(v | 0x80);
+        v >>= 7;
+    }
+    out += (char)v;
+}
+
+inline bool get_varint(const char*& p, const char* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+inline uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+inline int64_t unzigzag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+inline std::string file_header() {
+    std::string out(MAGIC, sizeof(MAGIC));
+    put_varint(out, VERSION);
+    return out;
+}
+
+// End of the blocks, then the size of the text file the map describes
+inline std::string file_trailer(uint64_t text_size) {
+    std::string out;
+    put_varint(out, 0);
+    put_varint(out, text_size);
+    return out;
+}
+
+// Map file that belongs to a generated text file: ic.txt -> ic.lmap
+inline std::string map_path(const std::string& text_path) {
+    size_t dot = text_path.rfind('.');
+    size_t slash = text_path.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return text_path + ".lmap";
+    }
+    return text_path.substr(0, dot) + ".lmap";
+}
+
+class Table {
+public:
+    Table() { frames_.push_back({0, 0, 0, 0}); }
+
+    // Id of a file or macro name
+    uint32_t intern(std::string_view s) {
+        auto it = string_ids_.find(std::string(s));
+        if (it != string_ids_.end()) return it->second;
+        uint32_t id = strings_.size();
+        strings_.emplace_back(s);
+        string_ids_.emplace(strings_.back(), id);
+        return id;
+    }
+
+    // Chain id for a call to `macro` at file:line made from inside `parent`.
+    // Every call gets a new frame; a caller that can see one call again keeps
+    // the id, as Upstream does.
+    uint32_t frame(uint32_t macro, uint32_t file, uint32_t line, uint32_t parent) {
+        frames_.push_back({macro, file, line, parent});
+        return frames_.size() - 1;
+    }
+
+    const std::string& str(uint32_t id) const { return strings_[id]; }
+
+    // The file whose lines Location::input counts, "" if none was named
+    std::string input_file() const { return input_file_ == NO_FILE ? "" : strings_[input_file_]; }
+    void set_input_file(std::string_view path) { input_file_ = intern(path); }
+    const Frame& frame_at(uint32_t chain) const { return frames_[chain]; }
+    size_t frame_count() const { return frames_.size(); }
+    const std::vector<Segment>& segments() const { return segments_; }
+    uint64_t text_size() const { return text_size_; }
+
+    // One past the last key with a location or address
+    uint64_t key_end() const {
+        uint64_t end = 0;
+        if (!segments_.empty()) end = segments_.back().key + segments_.back().count;
+        if (!addresses_.empty()) end = std::max(end, addresses_.back().key + addresses_.back().count);
+        return end;
+    }
+
+    // Record that `key` came from loc. Keys must increase; anything else is dropped.
+    void add(uint64_t key, const Location& loc) {
+        Segment s{key, 1, loc.file, loc.line, 0, loc.chain, loc.input, 0};
+        if (!segments_.empty()) {
+            if (key < segments_.back().key + segments_.back().count) return;
+            if (join(segments_.back(), s)) return;
+        }
+        segments_.push_back(s);
+    }
+
+    // Append the rows of another table, such as one block of a map file being
+    // read, with their keys moved up by key_offset. Its keys must come after
+    // this table's. Frames are copied as they are rather than merged with
+    // equal frames already here, so this costs one step per frame and segment.
+    void append(const Table& other, uint64_t key_offset) {
+        std::vector<uint32_t> strings(other.strings_.size());
+        for (size_t i = 0; i < strings.size(); ++i) strings[i] = intern(other.strings_[i]);
+        if (input_file_ == NO_FILE && other.input_file_ != NO_FILE) input_file_ = strings[other.input_file_];
+        std::vector<uint32_t> chains(other.frames_.size(), 0);
+        for (size_t i = 1; i < chains.size(); ++i) {
+            const Frame& f = other.frames_[i];
+            chains[i] = frames_.size();
+            frames_.push_back({strings[f.macro], strings[f.file], f.line, chains[f.parent]});
+        }
+        for (Segment s : other.segments_) {
+            s.key += key_offset;
+            s.file = strings[s.file];
+            s.chain = chains[s.chain];
+            if (segments_.empty() || !join(segments_.back(), s)) segments_.push_back(s);
+        }
+        for (AddressRun r : other.addresses_) {
+            r.key += key_offset;
+            addresses_.push_back(r);
+        }
+    }
+
+    // Record key's address. Keys must increase; anything else is dropped.
+    void add_address(uint64_t key, uint64_t address) {
+        if (!addresses_.empty()) {
+            AddressRun& r = addresses_.back();
+            uint64_t next = r.key + r.count;
+            if (key < next) return;
+            if (key == next) {
+                if (r.count == 1 && (address == r.address || address == r.address + 1)) {
+                    r.step = address - r.address;
+                    r.count++;
+                    return;
+                }
+                if (r.count > 1 && address == r.last_address() + r.step) {
+                    r.count++;
+                    return;
+                }
+            }
+        }
+        addresses_.push_back({key, 1, 0, address});
+    }
+
+    // Location recorded for key, or false if the key was never written
+    bool find(uint64_t key, Location& loc) const { return find(key, loc, hint_); }
+
+    // Same, with the caller keeping the search position, so that several
+    // threads can look up keys in one table
+    bool find(uint64_t key, Location& loc, size_t& hint) const {
+        size_t i;
+        if (!locate(segments_, key, hint, i)) return false;
+        const Segment& s = segments_[i];
+        loc.file = s.file;
+        loc.line = s.line + s.step * (uint32_t)(key - s.key);
+        loc.chain = s.chain;
+        loc.input = s.input + s.input_step * (uint32_t)(key - s.key);
+        return true;
+    }
+
+    // Address recorded for key, or false if it has none
+    bool address(uint64_t key, uint64_t& address) const { return this->address(key, address, address_hint_); }
+
+    bool address(uint64_t key, uint64_t& address, size_t& hint) const {
+        size_t i;
+        if (!locate(addresses_, key, hint, i)) return false;
+        const AddressRun& r = addresses_[i];
+        address = r.address + r.step * (key - r.key);
+        return true;
+    }
+
+    // "file:line", followed by one "in MACRO called from file:line" per expansion
+    // level and "via input:line" if the map names its input
+    std::string describe(const Location& loc) const {
+        std::string out = strings_[loc.file] + ":" + std::to_string(loc.line);
+        for (uint32_t c = loc.chain; c != 0; c = frames_[c].parent) {
+            const Frame& f = frames_[c];
+            out += " (in " + strings_[f.macro] + " called from " + strings_[f.file] + ":" +
+                   std::to_string(f.line) + ")";
+        }
+        if (input_file_ != NO_FILE && loc.input != 0) {
+            out += " via " + strings_[input_file_] + ":" + std::to_string(loc.input);
+        }
+        return out;
+    }
+
+    // The whole map file for this table, as one block. text_size is the size
+    // in bytes of the text file the map describes.
+    std::string encode(uint64_t text_size) const {
+        return file_header() + encode_block(key_end()) + file_trailer(text_size);
+    }
+
+    // This table as one block of a map file, body size included. The block
+    // after it has its keys counted from `span` keys past this one's.
+    std::string encode_block(uint64_t span) const {
+        std::string out;
+        put_varint(out, span);
+        put_varint(out, strings_.size());
+        for (const auto& s : strings_) {
+            put_varint(out, s.size());
+            out += s;
+        }
+        put_varint(out, input_file_ == NO_FILE ? 0 : input_file_ + 1);
+
+        // Frames are written where they are first needed and numbered in that
+        // order; ids[c] is frame c's number in the file, 0 until it is written
+        std::vector<uint32_t> ids(frames_.size(), 0);
+        uint32_t written = 0;
+        Predictor pred(strings_.size());
+
+        auto put_call_site = [&](std::string& to, const Frame& f) {
+            put_varint(to, f.file);
+            put_varint(to, zigzag((int64_t)f.line - (pred.last_line[0] + 1)));
+            put_varint(to, ids[f.parent]);
+        };
+        // Frame-only records for the ancestors of a chain that are not written yet
+        auto put_parents = [&](uint32_t chain, auto& self) -> void {
+            uint32_t parent = frames_[chain].parent;
+            if (parent == 0 || ids[parent] != 0) return;
+            self(parent, self);
+            const Frame& f = frames_[parent];
+            out += (char)(CHAIN_EXPLICIT << CHAIN_SHIFT | CALL_SITE);
+            put_varint(out, f.macro);
+            put_call_site(out, f);
+            ids[parent] = ++written;
+        };
+
+        put_varint(out, segments_.size());
+        for (const auto& s : segments_) {
+            uint32_t chain = ids[s.chain];
+            uint8_t chain_mode = s.chain != 0 && chain == 0 ? CHAIN_NEXT
+                               : chain == pred.prev.chain ? CHAIN_SAME
+                               : chain == 0 ? CHAIN_ROOT
+                               : CHAIN_EXPLICIT;
+            uint8_t flags = (uint8_t)(chain_mode << CHAIN_SHIFT);
+            std::string fields;
+            if (chain_mode == CHAIN_NEXT) {
+                put_parents(s.chain, put_parents);
+                const Frame& f = frames_[s.chain];
+                put_varint(fields, f.macro);
+                if (pred.implied(f)) {
+                    pred.last_line[0] = f.line;
+                } else {
+                    flags |= CALL_SITE;
+                    put_call_site(fields, f);
+                }
+                chain = ids[s.chain] = ++written;
+            } else if (chain_mode == CHAIN_EXPLICIT) {
+                put_varint(fields, chain);
+            }
+
+            uint32_t macro = s.chain == 0 ? 0 : frames_[s.chain].macro;
+            uint32_t line, count, input, input_step;
+            pred.guess(chain, macro, line, count);
+            pred.guess_input(chain, input, input_step);
+            uint64_t gap = s.key - (pred.prev.key + pred.prev.count);
+            if (gap != 0) flags |= KEY_GAP;
+            if (s.count != count) flags |= MULTI;
+            if (s.step == 1) flags |= STEP;
+            if (s.line != line) flags |= LINE_DELTA;
+            uint8_t more = 0;
+            if (s.file != pred.prev.file) more |= NEW_FILE;
+            if (s.input != input) more |= INPUT_DELTA;
+            if (s.count > 1 && s.input_step != input_step) more |= INPUT_STEP;
+            if (more) flags |= MORE;
+
+            out += (char)flags;
+            if (flags & MORE) out += (char)more;
+            out += fields;
+            if (flags & KEY_GAP) put_varint(out, gap);
+            if (flags & MULTI) put_varint(out, s.count - 1);
+            if (more & NEW_FILE) put_varint(out, s.file);
+            if (flags & LINE_DELTA) put_varint(out, zigzag((int64_t)s.line - line));
+            if (more & INPUT_DELTA) put_varint(out, zigzag((int64_t)s.input - input));
+
+            Segment written_segment = s;
+            written_segment.chain = chain;
+            pred.advance(written_segment, macro);
+        }
+
+        put_varint(out, addresses_.size());
+        AddressRun prev_run{0, 0, 0, 0};
+        for (const auto& r : addresses_) {
+            put_varint(out, r.key - (prev_run.key + prev_run.count));
+            put_varint(out, (uint64_t)(r.count - 1) << 1 | r.step);
+            put_varint(out, zigzag((int64_t)(r.address - (prev_run.last_address() + 1))));
+            prev_run = r;
+        }
+
+        std::string block;
+        put_varint(block, out.size());
+        return block + out;
+    }
+
+    bool decode(const char* p, const char* end) {
+        *this = Table();
+
+        uint64_t v;
+        if (end - p < (long)sizeof(MAGIC) || memcmp(p, MAGIC, sizeof(MAGIC)) != 0) return false;
+        p += sizeof(MAGIC);
+        if (!get_varint(p, end, v) || v != VERSION) return false;
+
+        uint64_t base = 0;
+        while (true) {
+            uint64_t size, span;
+            if (!get_varint(p, end, size)) return false;
+            if (size == 0) break;
+            if ((uint64_t)(end - p) < size) return false;
+            Table block;
+            if (!block.decode_block(p, p + size, span)) return false;
+            // Keys must keep increasing from one block to the next
+            if (block.key_end() != 0 && block.first_key() + base < key_end()) return false;
+            append(block, base);
+            base += span;
+            p += size;
+        }
+        if (!get_varint(p, end, text_size_)) return false;
+        return p == end;
+    }
+
+    bool save(const std::string& path, uint64_t text_size) const {
+        std::ofstream out(path, std::ios::binary);
+        if (!out.is_open()) return false;
+        std::string data = encode(text_size);
+        out.write(data.data(), data.size());
+        return (bool)out;
+    }
+
+    bool load(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open()) return false;
+        std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        return decode(data.data(), data.data() + data.size());
+    }
+
+    // Whether the text file still has the size this map recorded for it
+    bool matches(const std::string& text_path) const {
+        struct stat st;
+        return stat(text_path.c_str(), &st) == 0 && (uint64_t)st.st_size == text_size_;
+    }
+
+private:
+    // Read one block body written by encode_block() into this empty table
+    bool decode_block(const char* p, const char* end, uint64_t& span) {
+        uint64_t v;
+        if (!get_varint(p, end, span)) return false;
+
+        uint64_t string_count;
+        if (!get_varint(p, end, string_count)) return false;
+        for (uint64_t i = 0; i < string_count; ++i) {
+            if (!get_varint(p, end, v) || (uint64_t)(end - p) < v) return false;
+            strings_.emplace_back(p, v);
+            string_ids_.emplace(strings_.back(), (uint32_t)i);
+            p += v;
+        }
+        if (!get_varint(p, end, v) || v > strings_.size()) return false;
+        input_file_ = v == 0 ? NO_FILE : (uint32_t)(v - 1);
+
+        Predictor pred(strings_.size());
+        auto get_frame = [&](bool call_site, Frame& f) {
+            uint64_t macro, file, line, parent;
+            if (!get_varint(p, end, macro) || macro >= strings_.size()) return false;
+            f = {(uint32_t)macro, pred.root_file, pred.last_line[0] + 1, 0};
+            if (call_site) {
+                if (!get_varint(p, end, file) || !get_varint(p, end, line) || !get_varint(p, end, parent)) {
+                    return false;
+                }
+                if (file >= strings_.size() || parent >= frames_.size()) return false;
+                f.file = file;
+                f.line = (uint32_t)(pred.last_line[0] + 1 + unzigzag(line));
+                f.parent = parent;
+            } else {
+                pred.last_line[0] = f.line;
+            }
+            frames_.push_back(f);
+            return true;
+        };
+
+        uint64_t segment_count;
+        if (!get_varint(p, end, segment_count)) return false;
+        segments_.reserve(std::min<uint64_t>(segment_count, end - p));
+        while (segments_.size() < segment_count) {
+            if (p >= end) return false;
+            uint8_t flags = *p++;
+            uint8_t chain_mode = (flags >> CHAIN_SHIFT) & 3;
+            uint8_t more = 0;
+            if (flags & MORE) {
+                if (p >= end) return false;
+                more = *p++;
+            }
+            Frame f;
+            if (chain_mode == CHAIN_EXPLICIT && (flags & CALL_SITE)) {
+                if (!get_frame(true, f)) return false; // frame-only record
+                continue;
+            }
+
+            Segment s = pred.prev;
+            switch (chain_mode) {
+                case CHAIN_SAME: break;
+                case CHAIN_ROOT: s.chain = 0; break;
+                case CHAIN_NEXT:
+                    if (!get_frame(flags & CALL_SITE, f)) return false;
+                    s.chain = frames_.size() - 1;
+                    break;
+                case CHAIN_EXPLICIT:
+                    if (!get_varint(p, end, v) || v == 0 || v >= frames_.size()) return false;
+                    s.chain = v;
+                    break;
+            }
+
+            uint32_t macro = frames_[s.chain].macro;
+            pred.guess(s.chain, macro, s.line, s.count);
+            pred.guess_input(s.chain, s.input, s.input_step);
+            s.key = pred.prev.key + pred.prev.count;
+            s.step = (flags & STEP) ? 1 : 0;
+            if (flags & KEY_GAP) {
+                if (!get_varint(p, end, v)) return false;
+                s.key += v;
+            }
+            if (flags & MULTI) {
+                if (!get_varint(p, end, v) || v >= UINT32_MAX) return false;
+                s.count = (uint32_t)v + 1;
+            }
+            if (more & NEW_FILE) {
+                if (!get_varint(p, end, v) || v >= strings_.size()) return false;
+                s.file = v;
+            }
+            if (flags & LINE_DELTA) {
+                if (!get_varint(p, end, v)) return false;
+                s.line = (uint32_t)(s.line + unzigzag(v));
+            }
+            if (more & INPUT_DELTA) {
+                if (!get_varint(p, end, v)) return false;
+                s.input = (uint32_t)(s.input + unzigzag(v));
+            }
+            if (more & INPUT_STEP) s.input_step = 1 - s.input_step;
+
+            segments_.push_back(s);
+            pred.advance(s, macro);
+        }
+
+        uint64_t run_count;
+        if (!get_varint(p, end, run_count)) return false;
+        addresses_.reserve(std::min<uint64_t>(run_count, end - p));
+        AddressRun prev_run{0, 0, 0, 0};
+        for (uint64_t i = 0; i < run_count; ++i) {
+            uint64_t gap, shape, delta;
+            if (!get_varint(p, end, gap) || !get_varint(p, end, shape) || !get_varint(p, end, delta)) {
+                return false;
+            }
+            AddressRun r;
+            r.key = prev_run.key + prev_run.count + gap;
+            r.count = (uint32_t)(shape >> 1) + 1;
+            r.step = shape & 1;
+            r.address = prev_run.last_address() + 1 + unzigzag(delta);
+            addresses_.push_back(r);
+            prev_run = r;
+        }
+        return p == end;
+    }
+
+    // First key with a location or address; only meaningful if key_end() != 0
+    uint64_t first_key() const {
+        if (segments_.empty()) return addresses_.front().key;
+        if (addresses_.empty()) return segments_.front().key;
+        return std::min(segments_.front().key, addresses_.front().key);
+    }
+
+    // Registers that encode() and decode() keep in step to guess each
+    // segment's fields from the segments before it
+    struct Predictor {
+        Segment prev{0, 0, 0, 0, 0, 0, 0, 0};
+        // Lines inside macro bodies and outside them are delta coded separately,
+        // so a call does not cost two long jumps between call site and definition
+        uint32_t last_line[2] = {0, 0};
+        uint32_t root_file = 0; // file of the last segment outside any macro
+        // Input step of the last segment longer than one key, outside macros and in them
+        uint32_t input_step[2] = {1, 1};
+        // Per macro name, line and length of the first segment of its last expansion
+        std::vector<uint32_t> entry_line, entry_count;
+
+        explicit Predictor(size_t strings) : entry_line(strings, 0), entry_count(strings, 0) {}
+
+        // A call from the line after the last one outside any macro is not written
+        bool implied(const Frame& f) const {
+            return f.parent == 0 && f.file == root_file && f.line == last_line[0] + 1;
+        }
+
+        // The next segment in chain continues on the following line with one
+        // key, unless it enters an expansion of a macro seen before, which is
+        // expected to repeat that macro's previous expansion
+        void guess(uint32_t chain, uint32_t macro, uint32_t& line, uint32_t& count) const {
+            line = last_line[chain != 0] + 1;
+            count = 1;
+            if (chain != 0 && chain != prev.chain && entry_count[macro] != 0) {
+                line = entry_line[macro];
+                count = entry_count[macro];
+            }
+        }
+
+        // The next segment carries on from the input line after the last one
+        void guess_input(uint32_t chain, uint32_t& input, uint32_t& step) const {
+            input = prev.last_input() + 1;
+            step = input_step[chain != 0];
+        }
+
+        void advance(const Segment& s, uint32_t macro) {
+            if (s.chain != 0 && s.chain != prev.chain) {
+                entry_line[macro] = s.line;
+                entry_count[macro] = s.count;
+            }
+            if (s.chain == 0) root_file = s.file;
+            if (s.count > 1) input_step[s.chain != 0] = s.input_step;
+            last_line[s.chain != 0] = s.last_line();
+            prev = s;
+        }
+    };
+
+    // Extend s with t if t carries on where s ends
+    static bool join(Segment& s, const Segment& t) {
+        if (t.key != s.key + s.count || t.file != s.file || t.chain != s.chain) return false;
+        uint32_t step = t.line - s.last_line();
+        uint32_t input_step = t.input - s.last_input();
+        if (step > 1 || (s.count > 1 && step != s.step) || (t.count > 1 && step != t.step)) return false;
+        if (input_step > 1 || (s.count > 1 && input_step != s.input_step) ||
+            (t.count > 1 && input_step != t.input_step)) {
+            return false;
+        }
+        s.step = step;
+        s.input_step = input_step;
+        s.count += t.count;
+        return true;
+    }
+
+    template <class Run>
+    static bool contains(const Run& r, uint64_t key) {
+        return key >= r.key && key - r.key < r.count;
+    }
+
+    // Index of the run holding key. Stages look keys up in order, so the run
+    // used last time and the one after it are tried before a binary search.
+    template <class Run>
+    static bool locate(const std::vector<Run>& runs, uint64_t key, size_t& hint, size_t& i) {
+        if (runs.empty()) return false;
+        i = hint;
+        if (i >= runs.size() || !contains(runs[i], key)) {
+            if (i + 1 < runs.size() && contains(runs[i + 1], key)) {
+                i++;
+            } else {
+                auto it = std::upper_bound(runs.begin(), runs.end(), key,
+                    [](uint64_t k, const Run& r) { return k < r.key; });
+                if (it == runs.begin()) return false;
+                i = it - runs.begin() - 1;
+                if (!contains(runs[i], key)) return false;
+            }
+        }
+        hint = i;
+        return true;
+    }
+
+    std::vector<std::string> strings_;
+    std::unordered_map<std::string, uint32_t> string_ids_;
+    std::vector<Frame> frames_;
+    std::vector<Segment> segments_;
+    std::vector<AddressRun> addresses_;
+    uint32_t input_file_ = NO_FILE;
+    uint64_t text_size_ = 0;
+    mutable size_t hint_ = 0;
+    mutable size_t address_hint_ = 0;
+};
+
+// Writes a map file block by block, for stages that encode their map in
+// pieces (see Table::encode_block) rather than keep it whole
+class Writer {
+public:
+    bool open(const std::string& path) {
+        out_.open(path, std::ios::binary);
+        std::string header = file_header();
+        out_.write(header.data(), header.size());
+        return (bool)out_;
+    }
+
+    void write(const std::string& block) { out_.write(block.data(), block.size()); }
+
+    // Finish the file; text_size is the size in bytes of the text file it describes
+    bool close(uint64_t text_size) {
+        std::string trailer = file_trailer(text_size);
+        out_.write(trailer.data(), trailer.size());
+        out_.close();
+        return (bool)out_;
+    }
+
+private:
+    std::ofstream out_;
+};
+
+// Locations of the lines of a stage's input file, expressed in the output
+// table's ids. If the input has its own map (it was generated by an earlier
+// stage) locations are carried over from it; otherwise the input is the
+// original source and line n is simply input:n. A map whose recorded text
+// size differs from the input's is stale and is ignored with a warning.
+// The first Upstream bound to a table names the input its Location::input
+// lines count.
+class Upstream {
+public:
+    Upstream(Table& out, const std::string& input_path) : Upstream(input_path) {
+        bind(out);
+    }
+
+    // Only load the input's map, to be shared by Upstreams made from this one
+    explicit Upstream(const std::string& input_path) : input_path_(input_path) {
+        std::string path = map_path(input_path);
+        auto in = std::make_shared<Table>();
+        has_map_ = in->load(path);
+        if (has_map_ && !in->matches(input_path)) {
+            std::cout << "Warning: ignoring " << path << ", it does not match " << input_path << "." << std::endl;
+            has_map_ = false;
+        }
+        in_ = in;
+    }
+
+    // The same input as `loaded`, sharing its map without reading it again but
+    // resolving into `out`. Give each thread its own.
+    Upstream(Table& out, const Upstream& loaded)
+        : in_(loaded.in_), has_map_(loaded.has_map_), input_path_(loaded.input_path_) {
+        bind(out);
+    }
+
+    // Address the input's map gives its 1-based line, or false if it has none
+    bool address(uint32_t line, uint64_t& address) {
+        return has_map_ && in_->address(line, address, address_hint_);
+    }
+
+    // Location of the input's 1-based line
+    Location at(uint32_t line) {
+        Location loc;
+        if (!has_map_ || !in_->find(line, loc, hint_)) {
+            loc.file = file_;
+            loc.line = line;
+            loc.chain = 0;
+        } else {
+            loc.file = import_string(loc.file);
+            loc.chain = import_chain(loc.chain);
+        }
+        loc.input = line;
+        return loc;
+    }
+
+private:
+    void bind(Table& out) {
+        out_ = &out;
+        file_ = out.intern(input_path_);
+        if (out.input_file().empty()) out.set_input_file(input_path_);
+    }
+
+    uint32_t import_string(uint32_t id) {
+        if (id >= string_map_.size()) string_map_.resize(id + 1, UINT32_MAX);
+        if (string_map_[id] == UINT32_MAX) string_map_[id] = out_->intern(in_->str(id));
+        return string_map_[id];
+    }
+
+    uint32_t import_chain(uint32_t chain) {
+        if (chain == 0) return 0;
+        if (chain >= chain_map_.size()) chain_map_.resize(chain + 1, 0);
+        if (chain_map_[chain] == 0) {
+            const Frame& f = in_->frame_at(chain);
+            chain_map_[chain] = out_->frame(import_string(f.macro), import_string(f.file), f.line,
+                                           import_chain(f.parent));
+        }
+        return chain_map_[chain];
+    }
+
+    Table* out_ = nullptr;
+    std::shared_ptr<const Table> in_;
+    bool has_map_ = false;
+    std::string input_path_;
+    uint32_t file_ = 0;
+    size_t hint_ = 0;
+    size_t address_hint_ = 0;
+    std::vector<uint32_t> string_map_;
+    std::vector<uint32_t> chain_map_;
+};
+
+} // namespace line_map
+
+#endif
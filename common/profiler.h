@@ -0,0 +1,176 @@
+// profiler.h
+//
+// Built-in instrumentation for the assembler, macro processor and scheduler.
+// Scoped timers, named counters and allocation counts are always compiled in
+// and switched on at runtime with the SPOS_PROFILE environment variable:
+//
+//   SPOS_PROFILE=profile.json ./pass1     write the summary to profile.json
+//   SPOS_PROFILE=- ./pass1                write it to stderr
+//
+// The summary is a single JSON object written when the Session in main()
+// goes out of scope. When SPOS_PROFILE is unset every hook is one
+// predictable branch on a global flag.
+//
+// This header replaces the global operator new/delete to count allocations,
+// so include it from the file that defines main() and nowhere else (every
+// program in this repo is a single translation unit).
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include <sys/resource.h>
+
+namespace prof {
+
+inline const char* output_path() {
+    static const char* path = getenv("SPOS_PROFILE");
+    return path;
+}
+
+inline const bool enabled_flag = output_path() != nullptr && output_path()[0] != '\0';
+
+inline bool enabled() { return enabled_flag; }
+
+// Counters and timers append themselves to these lists when constructed.
+// Define them at namespace scope so registration happens before main().
+struct Counter;
+struct Timer;
+inline Counter* counters = nullptr;
+inline Counter** counters_tail = &counters;
+inline Timer* timers = nullptr;
+inline Timer** timers_tail = &timers;
+
+struct Counter {
+    const char* name;
+    std::atomic<uint64_t> value{0};
+    Counter* next = nullptr;
+
+    explicit Counter(const char* n) : name(n) {
+        *counters_tail = this;
+        counters_tail = &next;
+    }
+
+    void add(uint64_t n = 1) {
+        if (enabled()) value.fetch_add(n, std::memory_order_relaxed);
+    }
+};
+
+struct Timer {
+    const char* name;
+    std::atomic<uint64_t> ns{0};
+    std::atomic<uint64_t> calls{0};
+    Timer* next = nullptr;
+
+    explicit Timer(const char* n) : name(n) {
+        *timers_tail = this;
+        timers_tail = &next;
+    }
+};
+
+// Adds the time until the end of the enclosing block to a Timer
+class Scope {
+public:
+    explicit Scope(Timer& t) : timer_(enabled() ? &t : nullptr) {
+        if (timer_) start_ = std::chrono::steady_clock::now();
+    }
+
+    ~Scope() {
+        if (!timer_) return;
+        auto elapsed = std::chrono::steady_clock::now() - start_;
+        timer_->ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+                             std::memory_order_relaxed);
+        timer_->calls.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    Timer* timer_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+inline std::atomic<uint64_t> allocations{0};
+inline std::atomic<uint64_t> allocated_bytes{0};
+
+// Writes the JSON summary for the whole run when main() returns
+class Session {
+public:
+    explicit Session(const char* program) : program_(program), start_(std::chrono::steady_clock::now()) {}
+
+    ~Session() {
+        if (!enabled()) return;
+        FILE* out = (output_path()[0] == '-' && output_path()[1] == '\0') ? stderr : fopen(output_path(), "w");
+        if (!out) return;
+
+        double wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_).count();
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+        long peak_kb = usage.ru_maxrss / 1024;
+#else
+        long peak_kb = usage.ru_maxrss;
+#endif
+
+        fprintf(out, "{\n  \"program\": \"%s\",\n  \"wall_ms\": %.3f,\n  \"peak_rss_kb\": %ld,\n",
+                program_, wall_ms, peak_kb);
+
+        fprintf(out, "  \"timers\": {");
+        const char* sep = "\n";
+        for (Timer* t = timers; t; t = t->next) {
+            fprintf(out, "%s    \"%s\": {\"calls\": %llu, \"ms\": %.3f}", sep, t->name,
+                    (unsigned long long)t->calls.load(), t->ns.load() / 1e6);
+            sep = ",\n";
+        }
+        fprintf(out, "\n  },\n");
+
+        fprintf(out, "  \"counters\": {");
+        sep = "\n";
+        for (Counter* c = counters; c; c = c->next) {
+            fprintf(out, "%s    \"%s\": %llu", sep, c->name, (unsigned long long)c->value.load());
+            sep = ",\n";
+        }
+        fprintf(out, "\n  },\n");
+
+        fprintf(out, "  \"allocations\": {\"count\": %llu, \"bytes\": %llu}\n}\n",
+                (unsigned long long)allocations.load(), (unsigned long long)allocated_bytes.load());
+
+        if (out != stderr) fclose(out);
+    }
+
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+private:
+    const char* program_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+inline void* allocate(std::size_t size) {
+    if (enabled()) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    if (size == 0) size = 1;
+    void* p = std::malloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+} // namespace prof
+
+void* operator new(std::size_t size) { return prof::allocate(size); }
+void* operator new[](std::size_t size) { return prof::allocate(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+#endif
@@ -0,0 +1,221 @@
+// bench.cpp
+//
+// Throughput suite for the assembler and macro processor. Generates corpora
+// with gen_corpus, runs every stage on them and reports lines/s, MB/s and
+// peak memory, comparing lines/s against a stored baseline. Normally run
+// through tools/bench.sh, which builds the stages first.
+//
+//   bench --bin DIR --work DIR [--lines N,N,...] [--jobs J] [--repeat R]
+//         [--baseline FILE] [--save-baseline] [--tolerance P]
+//
+// Each stage runs R times (default 3) and the fastest run is reported.
+// Exits with status 2 if any stage is more than the tolerance (default 10%)
+// slower than its baseline.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <iomanip>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+struct RunResult {
+    bool ok;
+    double seconds;
+    double peak_mb;
+};
+
+// Run argv[0] with its working directory set to dir, discarding its output
+RunResult run(const string& dir, const vector<string>& args) {
+    auto start = chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (chdir(dir.c_str()) != 0) _exit(127);
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) dup2(devnull, STDOUT_FILENO);
+        vector<char*> argv;
+        for (const auto& a : args) argv.push_back((char*)a.c_str());
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    if (pid < 0) return {false, 0, 0};
+
+    int status = 0;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+#ifdef __APPLE__
+    double peak_mb = usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+    double peak_mb = usage.ru_maxrss / 1024.0;
+#endif
+    return {WIFEXITED(status) && WEXITSTATUS(status) == 0, seconds, peak_mb};
+}
+
+// Lines and bytes of a stage's input file
+pair<long, long> file_stats(const string& path) {
+    ifstream in(path, ios::binary);
+    long lines = 0, bytes = 0;
+    char buf[1 << 16];
+    while (in.read(buf, sizeof(buf)) || in.gcount() > 0) {
+        for (streamsize i = 0; i < in.gcount(); ++i) {
+            if (buf[i] == '\n') lines++;
+        }
+        bytes += in.gcount();
+    }
+    return {lines, bytes};
+}
+
+map<string, double> load_baseline(const string& path) {
+    map<string, double> baseline;
+    ifstream in(path);
+    string line;
+    while (getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        stringstream ss(line);
+        string stage;
+        long lines;
+        double rate;
+        if (ss >> stage >> lines >> rate) baseline[stage + " " + to_string(lines)] = rate;
+    }
+    return baseline;
+}
+
+vector<long> parse_sizes(const string& list) {
+    vector<long> sizes;
+    stringstream ss(list);
+    string item;
+    while (getline(ss, item, ',')) sizes.push_back(stol(item));
+    return sizes;
+}
+
+int main(int argc, char* argv[]) {
+    string bin, work, baseline_path;
+    vector<long> sizes = {100000, 1000000};
+    string jobs = "0";
+    bool save_baseline = false;
+    double tolerance = 0.10;
+    int repeat = 3;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--save-baseline") {
+            save_baseline = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            cout << "Missing value for " << arg << endl;
+            return 1;
+        }
+        string value = argv[++i];
+        if (arg == "--bin") bin = value;
+        else if (arg == "--work") work = value;
+        else if (arg == "--lines") sizes = parse_sizes(value);
+        else if (arg == "--jobs") jobs = value;
+        else if (arg == "--baseline") baseline_path = value;
+        else if (arg == "--tolerance") tolerance = stod(value);
+        else if (arg == "--repeat") repeat = max(1, stoi(value));
+        else {
+            cout << "Unknown option " << arg << endl;
+            return 1;
+        }
+    }
+    if (bin.empty() || work.empty()) {
+        cout << "Usage: " << argv[0] << " --bin DIR --work DIR [--lines N,N,...] [--jobs J] [--repeat R]"
+             << " [--baseline FILE] [--save-baseline] [--tolerance P]" << endl;
+        return 1;
+    }
+
+    map<string, double> baseline;
+    if (!baseline_path.empty() && !save_baseline) baseline = load_baseline(baseline_path);
+
+    // Each stage: name, command, input file it consumes
+    struct Stage {
+        string name;
+        vector<string> args;
+        string input;
+    };
+    vector<Stage> stages = {
+        {"assembler_pass1", {bin + "/assembler_pass1"}, "input.txt"},
+        {"assembler_pass2", {bin + "/assembler_pass2"}, "ic.txt"},
+        {"macro_pass1", {bin + "/macro_pass1"}, "input_macro.txt"},
+        {"macro_pass2", {bin + "/macro_pass2"}, "intermediate.txt"},
+        {"macro_pass2_parallel", {bin + "/macro_pass2", "-j", jobs}, "intermediate.txt"},
+    };
+
+    cout << left << setw(22) << "stage" << right << setw(10) << "lines" << setw(10) << "seconds"
+         << setw(14) << "lines/s" << setw(10) << "MB/s" << setw(10) << "peak MB"
+         << setw(18) << "vs baseline" << endl;
+
+    ostringstream new_baseline;
+    new_baseline << "# Written by tools/bench.sh --save-baseline; rates are specific to the machine that ran it\n";
+    new_baseline << "# stage lines lines_per_second\n";
+    bool regression = false;
+
+    for (long size : sizes) {
+        string n = to_string(size);
+        RunResult gen_asm = run(work, {bin + "/gen_corpus", "asm", "input.txt", "--lines", n});
+        RunResult gen_macro = run(work, {bin + "/gen_corpus", "macro", "input_macro.txt", "--lines", n});
+        if (!gen_asm.ok || !gen_macro.ok) {
+            cout << "Error generating corpus with " << size << " lines." << endl;
+            return 1;
+        }
+
+        for (const auto& stage : stages) {
+            pair<long, long> stats = file_stats(work + "/" + stage.input);
+            RunResult r = {true, 0, 0};
+            for (int i = 0; i < repeat; ++i) {
+                RunResult attempt = run(work, stage.args);
+                if (!attempt.ok) {
+                    cout << "Stage " << stage.name << " failed." << endl;
+                    return 1;
+                }
+                if (i == 0 || attempt.seconds < r.seconds) r.seconds = attempt.seconds;
+                r.peak_mb = max(r.peak_mb, attempt.peak_mb);
+            }
+
+            double lines_per_sec = stats.first / r.seconds;
+            double mb_per_sec = stats.second / (1024.0 * 1024.0) / r.seconds;
+            string key = stage.name + " " + n;
+            string compare = "-";
+            auto it = baseline.find(key);
+            if (it != baseline.end()) {
+                double change = (lines_per_sec - it->second) / it->second;
+                ostringstream ss;
+                ss << showpos << fixed << setprecision(1) << change * 100 << "%";
+                compare = ss.str();
+                if (change < -tolerance) {
+                    compare += " SLOWER";
+                    regression = true;
+                }
+            }
+
+            cout << left << setw(22) << stage.name << right << setw(10) << stats.first
+                 << fixed << setprecision(3) << setw(10) << r.seconds
+                 << setprecision(0) << setw(14) << lines_per_sec
+                 << setprecision(1) << setw(10) << mb_per_sec << setw(10) << r.peak_mb
+                 << setw(18) << compare << endl;
+
+            new_baseline << stage.name << " " << size << " " << fixed << setprecision(0) << lines_per_sec << "\n";
+        }
+    }
+
+    if (save_baseline && !baseline_path.empty()) {
+        ofstream out(baseline_path);
+        out << new_baseline.str();
+        cout << "Baseline written to " << baseline_path << endl;
+    }
+
+    return regression ? 2 : 0;
+}
@@ -0,0 +1,26 @@
+#!/bin/sh
+# Build every stage with optimisation and run the throughput suite.
+#
+#   tools/bench.sh                          compare against tools/bench_baseline.txt
+#   tools/bench.sh --lines 100000,10000000  choose corpus sizes
+#   tools/bench.sh --save-baseline          record this machine's numbers as the baseline
+#
+# Binaries and corpora go to $BENCH_DIR (default: bench_build/ in the repo).
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+OUT=${BENCH_DIR:-$ROOT/bench_build}
+CXX=${CXX:-g++}
+FLAGS="-std=c++17 -O2 -pthread"
+
+mkdir -p "$OUT/bin" "$OUT/work"
+
+$CXX $FLAGS -o "$OUT/bin/assembler_pass1" "$ROOT/assignment1/pass1_assembler.cpp"
+$CXX $FLAGS -o "$OUT/bin/assembler_pass2" "$ROOT/assignment1/pass2_assembler.cpp"
+$CXX $FLAGS -o "$OUT/bin/macro_pass1" "$ROOT/assignment2/pass1.cpp"
+$CXX $FLAGS -o "$OUT/bin/macro_pass2" "$ROOT/assignment2/pass2.cpp"
+$CXX $FLAGS -o "$OUT/bin/gen_corpus" "$ROOT/tools/gen_corpus.cpp"
+$CXX $FLAGS -o "$OUT/bin/bench" "$ROOT/tools/bench.cpp"
+
+exec "$OUT/bin/bench" --bin "$OUT/bin" --work "$OUT/work" --baseline "$ROOT/tools/bench_baseline.txt" "$@"
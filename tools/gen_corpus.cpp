@@ -0,0 +1,203 @@
+// gen_corpus.cpp
+//
+// Generate reproducible synthetic inputs for benchmarking.
+//
+//   gen_corpus asm <out.txt> [options]     program for assignment1 (input.txt)
+//   gen_corpus macro <out.txt> [options]   program for assignment2 (input_macro.txt)
+//
+// Options (defaults in brackets):
+//   --lines N            statements in the program body [100000], up to 10M
+//   --seed S             random seed [1]
+//   --label-density P    fraction of statements that define a label [0.2]
+//   --symbols N          data symbols declared at the end with DS/DC [1000]
+//   --literal-rate P     fraction of statements with a literal operand [0.1]
+//   --literal-reuse P    chance a literal repeats an earlier value [0.5]
+//   --ltorg-every N      emit LTORG after every N statements, 0 = never [1000]
+//   --macros N           macro definitions (macro only) [50]
+//   --call-density P     fraction of statements that call a macro (macro only) [0.2]
+//
+// The same seed and options always produce the same file, on any platform.
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <sstream>
+
+using namespace std;
+
+struct Options {
+    long lines = 100000;
+    unsigned seed = 1;
+    double label_density = 0.2;
+    int symbols = 1000;
+    double literal_rate = 0.1;
+    double literal_reuse = 0.5;
+    long ltorg_every = 1000;
+    int macros = 50;
+    double call_density = 0.2;
+};
+
+const char* REGISTERS[] = {"AREG,", "BREG,", "CREG,"};
+const char* REGISTER_OPS[] = {"MOVER", "MOVEM", "ADD", "SUB", "MULT", "COMP"};
+const char* MEMORY_OPS[] = {"READ", "PRINT"};
+
+class Generator {
+public:
+    explicit Generator(const Options& opt) : opt_(opt), rng_(opt.seed) {}
+
+    // Plain arithmetic on the engine output, because the standard distributions
+    // are allowed to differ between library implementations
+    bool chance(double p) { return (rng_() >> 11) * (1.0 / 9007199254740992.0) < p; }
+    long pick(long n) { return (long)(rng_() % (uint64_t)n); }
+
+    string symbol() { return "D" + to_string(pick(opt_.symbols)); }
+
+    string literal() {
+        int value;
+        if (!literals_.empty() && chance(opt_.literal_reuse)) {
+            value = literals_[pick(literals_.size())];
+        } else {
+            value = next_literal_++;
+            literals_.push_back(value);
+        }
+        return "='" + to_string(value) + "'";
+    }
+
+    // One imperative statement using the given operand for memory references
+    string instruction(const string& operand) {
+        if (chance(0.1)) {
+            return string(MEMORY_OPS[pick(2)]) + " " + operand;
+        }
+        return string(REGISTER_OPS[pick(6)]) + " " + REGISTERS[pick(3)] + " " + operand;
+    }
+
+    string statement() {
+        string line;
+        if (chance(opt_.label_density)) line = "L" + to_string(labels_++) + " ";
+        return line + instruction(chance(opt_.literal_rate) ? literal() : symbol());
+    }
+
+    void write_body(ostream& out, const vector<string>& macro_calls) {
+        out << "START 100\n";
+        for (long i = 1; i <= opt_.lines; ++i) {
+            if (!macro_calls.empty() && chance(opt_.call_density)) {
+                out << macro_calls[pick(macro_calls.size())] << "\n";
+            } else {
+                out << statement() << "\n";
+            }
+            if (opt_.ltorg_every > 0 && i % opt_.ltorg_every == 0) out << "LTORG\n";
+        }
+        for (int i = 0; i < opt_.symbols; ++i) {
+            if (i % 2 == 0) out << "D" << i << " DS 1\n";
+            else out << "D" << i << " DC '" << i << "'\n";
+        }
+        out << "END\n";
+    }
+
+    // Macro definitions, followed by a call template for each macro
+    vector<string> write_macros(ostream& out) {
+        vector<string> calls;
+        for (int k = 0; k < opt_.macros; ++k) {
+            string name = "MAC" + to_string(k);
+            int params = 1 + pick(3);
+
+            out << name << " MACRO";
+            for (int p = 0; p < params; ++p) {
+                out << (p ? ", " : " ") << "&P" << p;
+            }
+            out << "\n";
+
+            int body = 2 + pick(4);
+            for (int b = 0; b < body; ++b) {
+                string operand = chance(opt_.literal_rate) ? literal() : "&P" + to_string(pick(params));
+                out << instruction(operand) << "\n";
+            }
+            out << "MEND\n";
+
+            string call = name;
+            for (int p = 0; p < params; ++p) {
+                call += (p ? ", " : " ") + symbol();
+            }
+            calls.push_back(call);
+        }
+        return calls;
+    }
+
+private:
+    Options opt_;
+    mt19937_64 rng_;
+    vector<int> literals_;
+    int next_literal_ = 1;
+    long labels_ = 0;
+};
+
+void usage(const char* program) {
+    cout << "Usage: " << program << " asm|macro <out.txt> [options]" << endl;
+}
+
+// Read a whole option value; false if it is not a number of type T
+template <class T>
+bool parse_value(const string& text, T& value) {
+    istringstream in(text);
+    return in >> value && in.peek() == char_traits<char>::eof();
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3 || (string(argv[1]) != "asm" && string(argv[1]) != "macro")) {
+        usage(argv[0]);
+        return 1;
+    }
+    string kind = argv[1];
+
+    Options opt;
+    for (int i = 3; i < argc; ++i) {
+        string arg = argv[i];
+        if (i + 1 >= argc) {
+            cout << "Missing value for " << arg << endl;
+            return 1;
+        }
+        string value = argv[++i];
+        bool parsed;
+        if (arg == "--lines") parsed = parse_value(value, opt.lines);
+        else if (arg == "--seed") parsed = parse_value(value, opt.seed);
+        else if (arg == "--label-density") parsed = parse_value(value, opt.label_density);
+        else if (arg == "--symbols") parsed = parse_value(value, opt.symbols);
+        else if (arg == "--literal-rate") parsed = parse_value(value, opt.literal_rate);
+        else if (arg == "--literal-reuse") parsed = parse_value(value, opt.literal_reuse);
+        else if (arg == "--ltorg-every") parsed = parse_value(value, opt.ltorg_every);
+        else if (arg == "--macros") parsed = parse_value(value, opt.macros);
+        else if (arg == "--call-density") parsed = parse_value(value, opt.call_density);
+        else {
+            cout << "Unknown option " << arg << endl;
+            return 1;
+        }
+        if (!parsed) {
+            cout << "Invalid value for " << arg << ": " << value << endl;
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (opt.lines < 0 || opt.lines > 10000000 || opt.symbols < 1 || opt.macros < 0) {
+        cout << "Option out of range." << endl;
+        return 1;
+    }
+
+    ofstream out(argv[2]);
+    if (!out.is_open()) {
+        cout << "Error opening output file." << endl;
+        return 1;
+    }
+
+    Generator gen(opt);
+    vector<string> calls;
+    if (kind == "macro") calls = gen.write_macros(out);
+    gen.write_body(out, calls);
+
+    if (!out) {
+        cout << "Error writing output file." << endl;
+        return 1;
+    }
+    return 0;
+}
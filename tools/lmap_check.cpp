@@ -0,0 +1,207 @@
+// lmap_check.cpp
+//
+// Round-trip check for the line map codec in common/line_map.h. Builds random
+// tables with nested macro frames, input lines, key gaps and addresses,
+// encodes them, decodes the result and compares describe() and address() for
+// every key with what was put in. Each table is checked on its own, and
+// several are also joined with Table::append() and written as one block each,
+// the way macro pass 2 streams expanded_code.lmap.
+//
+//   lmap_check [tables] [seed]     defaults: 1000 tables, seed 1
+//
+// Prints the first mismatch and exits with 1, otherwise prints "ok".
+
+#include <cctype>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../common/line_map.h"
+
+using namespace std;
+
+class Random {
+public:
+    explicit Random(uint64_t seed) : rng_(seed) {}
+
+    uint32_t pick(uint32_t n) { return (uint32_t)(rng_() % n); }
+    bool chance(double p) { return (rng_() >> 11) * (1.0 / 9007199254740992.0) < p; }
+
+private:
+    mt19937_64 rng_;
+};
+
+// What each key should look up to: describe() of the location it was added
+// with or "?", and its address or -1
+struct Expected {
+    vector<string> rows;
+    vector<int64_t> addresses;
+};
+
+// A table with keys in [0, keys), recorded in expected from key `base` on.
+// Rows mostly carry on from the previous line and input line, so they join
+// into segments the way real maps do, and calls enter macros from the line
+// after the last one outside them, nest, and repeat earlier expansions.
+line_map::Table random_table(Random& r, uint64_t keys, bool named_input, Expected& expected, uint64_t base) {
+    expected.rows.resize(base + keys, "?");
+    expected.addresses.resize(base + keys, -1);
+    line_map::Table t;
+    if (named_input) t.set_input_file("input.txt");
+    uint32_t files[] = {t.intern("a.txt"), t.intern("b.txt")};
+    uint32_t macros[] = {t.intern("M0"), t.intern("M1"), t.intern("M2")};
+    vector<uint32_t> chains = {0};
+    line_map::Location loc = {files[0], 1, 0, 1};
+    uint32_t root_line = 1;
+    uint64_t address = r.pick(200);
+
+    uint64_t key = r.pick(3);
+    while (key < keys) {
+        switch (r.pick(7)) {
+            case 0:
+            case 1: { // a call, nested in the current expansion one time in four
+                uint32_t parent = loc.chain != 0 && r.chance(0.25) ? loc.chain : 0;
+                uint32_t call_line = r.chance(0.8) ? root_line + 1 : r.pick(300);
+                chains.push_back(t.frame(macros[r.pick(3)], files[r.pick(2)], call_line, parent));
+                if (parent == 0) root_line = call_line;
+                loc.chain = chains.back();
+                loc.line = 10 + r.pick(4) * 10;
+                break;
+            }
+            case 2: // back outside any macro
+                loc.chain = 0;
+                loc.line = ++root_line;
+                break;
+            case 3: // an earlier chain again
+                loc.chain = chains[r.pick(chains.size())];
+                break;
+            case 4: // somewhere else entirely
+                loc.file = files[r.pick(2)];
+                loc.line = r.pick(1000);
+                break;
+            case 5:
+                key += 1 + r.pick(4);
+                break;
+            default:
+                break;
+        }
+        if (r.chance(0.2)) loc.input = r.chance(0.5) ? loc.input + r.pick(4) : r.pick(1000);
+        if (r.chance(0.05)) address = r.pick(1000);
+
+        uint32_t count = 1 + r.pick(6);
+        uint32_t step = r.chance(0.7) ? 1 : 0;
+        uint32_t input_step = r.chance(loc.chain != 0 ? 0.3 : 0.8) ? 1 : 0;
+        for (uint32_t i = 0; i < count && key < keys; ++i, ++key) {
+            t.add(key, loc);
+            expected.rows[base + key] = t.describe(loc);
+            if (r.chance(0.5)) {
+                t.add_address(key, address);
+                expected.addresses[base + key] = address;
+            }
+            address += r.pick(3);
+            loc.line += step;
+            loc.input += input_step;
+            if (loc.chain == 0) root_line = loc.line;
+        }
+    }
+    return t;
+}
+
+// Compare every key, and two past the last; on a difference say what it was in `why`
+bool same_rows(const Expected& expected, const line_map::Table& table, string& why) {
+    for (uint64_t key = 0; key < expected.rows.size() + 2; ++key) {
+        line_map::Location loc;
+        string want = key < expected.rows.size() ? expected.rows[key] : "?";
+        string got = table.find(key, loc) ? table.describe(loc) : "?";
+        if (want != got) {
+            why = "key " + to_string(key) + ": expected " + want + ", found " + got;
+            return false;
+        }
+
+        int64_t want_address = key < expected.addresses.size() ? expected.addresses[key] : -1;
+        uint64_t address;
+        int64_t got_address = table.address(key, address) ? (int64_t)address : -1;
+        if (want_address != got_address) {
+            why = "key " + to_string(key) + ": expected address " + to_string(want_address) + ", found " +
+                  to_string(got_address);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool round_trip(const Expected& expected, const string& encoded, uint64_t text_size, string& why) {
+    line_map::Table decoded;
+    if (!decoded.decode(encoded.data(), encoded.data() + encoded.size())) {
+        why = "decode failed";
+        return false;
+    }
+    if (decoded.text_size() != text_size) {
+        why = "text size " + to_string(text_size) + " decoded as " + to_string(decoded.text_size());
+        return false;
+    }
+    return same_rows(expected, decoded, why);
+}
+
+// Parse a count or seed: a plain decimal number
+bool parse_number(const string& text, uint64_t& value) {
+    if (text.empty() || text.size() > 18) return false;
+    value = 0;
+    for (char c : text) {
+        if (!isdigit((unsigned char)c)) return false;
+        value = value * 10 + (c - '0');
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t tables = 1000, seed = 1;
+    if (argc > 3 || (argc > 1 && !parse_number(argv[1], tables)) || (argc > 2 && !parse_number(argv[2], seed))) {
+        cout << "Usage: " << argv[0] << " [tables] [seed]" << endl;
+        return 1;
+    }
+
+    Random r(seed);
+    for (uint64_t n = 0; n < tables; ++n) {
+        string why;
+        bool named_input = r.chance(0.8);
+        uint64_t text_size = r.pick(1 << 30);
+
+        // One table, as built and saved whole
+        Expected expected;
+        line_map::Table table = random_table(r, 1 + r.pick(2000), named_input, expected, 0);
+        if (!same_rows(expected, table, why) || !round_trip(expected, table.encode(text_size), text_size, why)) {
+            cout << "table " << n << ", whole: " << why << endl;
+            return 1;
+        }
+
+        // Several tables, each written as a block and joined with append()
+        Expected joined_expected;
+        line_map::Table joined;
+        string encoded = line_map::file_header();
+        uint64_t base = 0;
+        for (uint32_t blocks = 1 + r.pick(4); blocks > 0; --blocks) {
+            uint64_t span = r.pick(600);
+            line_map::Table block = random_table(r, span, named_input, joined_expected, base);
+            encoded += block.encode_block(span);
+            joined.append(block, base);
+            base += span;
+        }
+        encoded += line_map::file_trailer(text_size);
+        if (!round_trip(joined_expected, encoded, text_size, why)) {
+            cout << "table " << n << ", in blocks: " << why << endl;
+            return 1;
+        }
+
+        // The joined table, as appended and saved whole again
+        if (!same_rows(joined_expected, joined, why) ||
+            !round_trip(joined_expected, joined.encode(text_size), text_size, why)) {
+            cout << "table " << n << ", joined: " << why << endl;
+            return 1;
+        }
+    }
+
+    cout << "ok: " << tables << " tables" << endl;
+    return 0;
+}
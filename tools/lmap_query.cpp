@@ -0,0 +1,120 @@
+// lmap_query.cpp
+//
+// Resolve addresses (or output line numbers) through a line map written by
+// one of the passes, e.g.
+//
+//   lmap_query machine_code.lmap 203 204
+//   lmap_query expanded_code.lmap < lines.txt
+//   lmap_query --dump machine_code.lmap
+//
+// Each key prints its original location, then the line of every generated
+// file in between that it came from, as far back as those files' maps are
+// found next to the given one:
+//
+//   112 input_macro.txt:4 (in MAC3 called from input_macro.txt:57) via ic.txt:9, input.txt:40
+
+#include <cctype>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../common/line_map.h"
+
+using namespace std;
+
+// Maps of the stages before the one at path: the map of its input, then the
+// map of that map's input, and so on while they exist and still match
+vector<line_map::Table> load_inputs(const string& path, const line_map::Table& map) {
+    size_t slash = path.find_last_of('/');
+    string dir = slash == string::npos ? "" : path.substr(0, slash + 1);
+    vector<line_map::Table> inputs;
+    string input = map.input_file();
+    while (!input.empty() && inputs.size() < 16) {
+        string text = dir + input;
+        line_map::Table next;
+        if (!next.load(line_map::map_path(text)) || !next.matches(text)) break;
+        input = next.input_file();
+        inputs.push_back(std::move(next));
+    }
+    return inputs;
+}
+
+// Parse a key: a plain decimal number that fits in 64 bits
+bool parse_key(const string& text, uint64_t& key) {
+    if (text.empty()) return false;
+    uint64_t value = 0;
+    for (char c : text) {
+        if (!isdigit((unsigned char)c)) return false;
+        if (value > (UINT64_MAX - (c - '0')) / 10) return false;
+        value = value * 10 + (c - '0');
+    }
+    key = value;
+    return true;
+}
+
+void print(const line_map::Table& map, const vector<line_map::Table>& inputs, uint64_t key) {
+    line_map::Location loc;
+    if (!map.find(key, loc)) {
+        cout << key << " ?" << endl;
+        return;
+    }
+    cout << key << " " << map.describe(loc);
+    for (const auto& input : inputs) {
+        if (loc.input == 0 || !input.find(loc.input, loc) || loc.input == 0) break;
+        cout << ", " << input.input_file() << ":" << loc.input;
+    }
+    cout << endl;
+}
+
+int main(int argc, char* argv[]) {
+    bool dump = false;
+    int first = 1;
+    if (argc > 1 && string(argv[1]) == "--dump") {
+        dump = true;
+        first = 2;
+    }
+    vector<uint64_t> keys(max(0, argc - first - 1));
+    bool valid = first < argc;
+    for (int i = first + 1; valid && i < argc; ++i) {
+        valid = parse_key(argv[i], keys[i - first - 1]);
+    }
+    if (!valid) {
+        cout << "Usage: " << argv[0] << " [--dump] <file.lmap> [key...]" << endl;
+        return 1;
+    }
+
+    line_map::Table map;
+    if (!map.load(argv[first])) {
+        cout << "Error reading line map " << argv[first] << "." << endl;
+        return 1;
+    }
+    vector<line_map::Table> inputs = load_inputs(argv[first], map);
+
+    if (dump) {
+        for (const auto& s : map.segments()) {
+            for (uint32_t i = 0; i < s.count; ++i) {
+                print(map, inputs, s.key + i);
+            }
+        }
+        return 0;
+    }
+
+    if (!keys.empty()) {
+        for (uint64_t key : keys) {
+            print(map, inputs, key);
+        }
+    } else {
+        string word;
+        uint64_t key;
+        while (cin >> word) {
+            if (!parse_key(word, key)) {
+                cout << "Invalid key " << word << "." << endl;
+                return 1;
+            }
+            print(map, inputs, key);
+        }
+    }
+
+    return 0;
+}